@@ -0,0 +1,308 @@
+#include <zmqls/server.hpp>
+#include <zmqls/client.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cxxopts/cxxopts.hpp>
+#include <json/json.hpp>
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/histogram.hpp>
+
+// End-to-end benchmark: one server stream and N headless client streams
+// in a single process, swept over transports, codecs, frame sizes, 
+// qualities, subscriber counts and encoder thread counts. Results are
+// written as a JSON array.
+
+using namespace std;
+using namespace std::chrono;
+using json = nlohmann::json;
+
+struct run_t {
+        string transport;
+        string codec;
+        cv::Size size;
+        uint quality;
+        uint subscribers;
+        uint encoders;
+};
+
+template <typename T> static vector<T> split(const string &s, T (*conv)(const string &))
+{
+        vector<T> ret;
+        stringstream ss(s);
+        string item;
+        while (getline(ss, item, ','))
+                if (!item.empty())
+                        ret.push_back(conv(item));
+
+        return ret;
+}
+
+static string to_str(const string &s) { return s; }
+static uint to_uint(const string &s) { return (uint) stoul(s); }
+static cv::Size to_size(const string &s)
+{
+        auto x = s.find('x');
+        if (x == string::npos)
+                return cv::Size();
+
+        return cv::Size(stoi(s.substr(0, x)), stoi(s.substr(x + 1)));
+}
+
+// Every run gets an endpoint of its own so nothing lingers between runs
+static string endpoint(const string &transport, uint port, size_t index)
+{
+        if (transport == "inproc")
+                return "inproc://zmqls-bench-" + to_string(index);
+        if (transport == "ipc")
+                return "ipc:///tmp/zmqls-bench-" + to_string(getpid())
+                        + "-" + to_string(index);
+        if (transport == "tcp")
+                return "tcp://127.0.0.1:" + to_string(port + index);
+
+        return "";
+}
+
+static json percentiles(const zmqls::histogram &h)
+{
+        return {
+                {"mean", h.mean()},
+                {"p50", h.percentile(0.5)},
+                {"p99", h.percentile(0.99)},
+                {"p999", h.percentile(0.999)},
+                {"max", h.max()}
+        };
+}
+
+static json bench(zmq::context_t &ctx, const run_t &r, const string &address,
+        double seconds, uint noise)
+{
+        // Frames come from memory as fast as the pipeline takes them, 
+        // capture waits for the encoders rather than spinning and dropping
+        json sj = {
+                {"name", "bench-server"},
+                {"address", address},
+                {"prefix", "bench"},
+                {"codec", r.codec},
+                {"encoders", r.encoders},
+                {"backpressure", true},
+                {"source", {
+                        {"type", "memory"},
+                        {"frames", 30u},
+                        {"fps", 0},
+                        {"from", {
+                                {"type", "pattern"},
+                                {"width", (uint) r.size.width},
+                                {"height", (uint) r.size.height},
+                                {"noise", noise}
+                        }}
+                }}
+        };
+        // Only lossy codecs have a quality, the others keep their defaults
+        if (r.codec == "jpeg" || r.codec == "webp")
+                sj["encode"] = r.quality;
+        zmqls::server::stream server(sj);
+
+        int server_ret = EXIT_SUCCESS;
+        thread server_thread([&]{ server_ret = server.start(ctx); });
+
+        // Give the server time to preload and bind before anyone connects
+        this_thread::sleep_for(milliseconds(500));
+
+        // Headless clients stop by themselves after the run time
+        zmqls::client::display display;
+        vector<unique_ptr<zmqls::client::stream>> clients;
+        for (uint i = 0; i < r.subscribers; ++i) {
+                json cj = {
+                        {"name", "bench-client-" + to_string(i)},
+                        {"address", address},
+                        {"prefix", "bench"},
+                        {"sink", "headless"},
+                        {"report", 0},
+                        {"duration", seconds}
+                };
+                clients.emplace_back(new zmqls::client::stream(cj, display));
+        }
+
+        // Server counters are sampled around the measured window, so 
+        // preloading and warming up are left out (CPU times are kept
+        // current by the stages while they run)
+        const auto &ss = server.stats();
+        uint64_t frames_before = ss.frames;
+        uint64_t bytes_before = ss.bytes;
+        uint64_t dropped_before = ss.dropped;
+        int64_t capture_cpu_before = ss.capture_cpu_us;
+        int64_t encode_cpu_before = ss.encode_cpu_us;
+        int64_t publish_cpu_before = ss.publish_cpu_us;
+        auto started = steady_clock::now();
+
+        vector<thread> client_threads;
+        for (auto &c : clients)
+                client_threads.emplace_back([&ctx, &c]{ c->start(ctx); });
+        for (auto &t : client_threads)
+                t.join();
+
+        double secs = duration<double>(steady_clock::now() - started).count();
+        uint64_t frames = ss.frames - frames_before;
+        uint64_t bytes = ss.bytes - bytes_before;
+        uint64_t dropped = ss.dropped - dropped_before;
+        int64_t capture_cpu = ss.capture_cpu_us - capture_cpu_before;
+        int64_t encode_cpu = ss.encode_cpu_us - encode_cpu_before;
+        int64_t publish_cpu = ss.publish_cpu_us - publish_cpu_before;
+
+        server.stop();
+        server_thread.join();
+
+        // Clients are summed up, latency over every frame any of them got
+        zmqls::histogram latency;
+        zmqls::histogram decode;
+        uint64_t client_frames = 0;
+        uint64_t client_bytes = 0;
+        uint64_t lost = 0;
+        int64_t receive_cpu = 0;
+        int64_t decode_cpu = 0;
+        for (const auto &c : clients) {
+                const auto &cs = c->stats();
+                latency.merge(cs.latency);
+                decode.merge(cs.decode);
+                client_frames += cs.frames;
+                client_bytes += cs.bytes;
+                lost += cs.lost;
+                receive_cpu += cs.receive_cpu_us;
+                decode_cpu += cs.decode_cpu_us;
+        }
+
+        double n = r.subscribers ? r.subscribers : 1;
+        return {
+                {"transport", r.transport},
+                {"codec", r.codec},
+                {"width", r.size.width},
+                {"height", r.size.height},
+                {"quality", r.quality},
+                {"subscribers", r.subscribers},
+                {"encoders", r.encoders},
+                {"seconds", secs},
+                {"ok", server_ret == EXIT_SUCCESS},
+                {"server", {
+                        {"frames_per_s", frames / secs},
+                        {"mb_per_s", bytes / secs / 1e6},
+                        {"dropped", dropped},
+                        {"cpu_s", {
+                                {"capture", capture_cpu / 1e6},
+                                {"encode", encode_cpu / 1e6},
+                                {"publish", publish_cpu / 1e6}
+                        }},
+                        {"cpu_us_per_frame", frames ? (capture_cpu + encode_cpu 
+                                + publish_cpu) / (double) frames : 0.0},
+                        {"encode_us", percentiles(ss.encode)},
+                        {"publish_us", percentiles(ss.publish)}
+                }},
+                {"clients", {
+                        {"frames_per_s", client_frames / secs / n},
+                        {"mb_per_s", client_bytes / secs / 1e6},
+                        {"lost", lost},
+                        {"cpu_s", {
+                                {"receive", receive_cpu / 1e6},
+                                {"decode", decode_cpu / 1e6}
+                        }},
+                        {"decode_us", percentiles(decode)},
+                        {"latency_us", percentiles(latency)}
+                }}
+        };
+}
+
+int main(int argc, char **argv)
+{
+        bool help = false;
+        string transports, codecs, resolutions, qualities, subscribers, encoders, output;
+        double seconds = 3;
+        uint threads = 1, port = 5600, noise = 8;
+
+        cxxopts::Options opt("zmqls_bench",
+                "End-to-end zmqls benchmark over inproc, ipc and tcp loopback");
+        opt.add_options()
+                ("help", "Print help message", cxxopts::value(help))
+                ("transports", "Comma-separated transports (inproc, ipc, tcp)",
+                        cxxopts::value(transports)->default_value("inproc,ipc,tcp"))
+                ("codecs", "Comma-separated codecs (jpeg, raw, png, webp, raw+lz4, raw+zstd)",
+                        cxxopts::value(codecs)->default_value("jpeg"))
+                ("resolutions", "Comma-separated WxH frame sizes",
+                        cxxopts::value(resolutions)->default_value("640x480,1280x720,1920x1080"))
+                ("qualities", "Comma-separated JPEG and WebP qualities",
+                        cxxopts::value(qualities)->default_value("80"))
+                ("subscribers", "Comma-separated subscriber counts",
+                        cxxopts::value(subscribers)->default_value("1,4"))
+                ("encoders", "Comma-separated encoder thread counts",
+                        cxxopts::value(encoders)->default_value("1,4"))
+                ("seconds", "Measured time per run",
+                        cxxopts::value(seconds)->default_value("3"))
+                ("t,threads", "Number of threads to use for ZMQ",
+                        cxxopts::value(threads)->default_value("1"))
+                ("port", "First TCP port to use",
+                        cxxopts::value(port)->default_value("5600"))
+                ("noise", "Noise amplitude of the test pattern",
+                        cxxopts::value(noise)->default_value("8"))
+                ("o,output", "Write results here instead of stdout",
+                        cxxopts::value(output));
+
+        try {
+                opt.parse(argc, argv);
+        } catch (const cxxopts::OptionParseException &e) {
+                cerr << "zmqls_bench: " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+        if (help) {
+                cout << opt.help();
+                return EXIT_SUCCESS;
+        }
+
+        // Build the sweep, every combination of every list
+        vector<run_t> runs;
+        for (const auto &t : split(transports, &to_str))
+                for (const auto &c : split(codecs, &to_str))
+                        for (const auto &s : split(resolutions, &to_size))
+                                for (auto q : split(qualities, &to_uint))
+                                        for (auto n : split(subscribers, &to_uint))
+                                                for (auto e : split(encoders, &to_uint))
+                                                        runs.push_back({t, c, s, q, n, e});
+
+        zmq::context_t ctx(threads);
+
+        json results = json::array();
+        for (size_t i = 0; i < runs.size(); ++i) {
+                const auto &r = runs[i];
+                auto address = endpoint(r.transport, port, i);
+                if (address.empty() || !r.size.area()) {
+                        cerr << "zmqls_bench: Skipping invalid run " << i << endl;
+                        continue;
+                }
+
+                cerr << "zmqls_bench: [" << i + 1 << "/" << runs.size() << "] "
+                        << r.transport << " " << r.codec << " " << r.size.width << "x"
+                        << r.size.height << " q" << r.quality << ", "
+                        << r.subscribers << " subscribers, "
+                        << r.encoders << " encoders" << endl;
+                results.push_back(bench(ctx, r, address, seconds, noise));
+        }
+
+        if (output.empty()) {
+                cout << results.dump(2) << endl;
+        } else {
+                ofstream out(output);
+                out << results.dump(2) << endl;
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+#include <zmqls/zmqls.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cxxopts/cxxopts.hpp>
+#include <json/json.hpp>
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/json.hpp>
+#include <zmqls/codec.hpp>
+#include <zmqls/source.hpp>
+#include <zmqls/transform.hpp>
+
+// Micro-benchmarks of the per-frame hot paths in zmqls_lib: message
+// construction, raw image copies, JPEG encode/decode, every codec and
+// every client transform. Results are a JSON object of nanoseconds per operation,
+// which can be stored as a baseline and compared against later runs.
+
+using namespace std;
+using namespace std::chrono;
+using json = nlohmann::json;
+
+struct result_t {
+        double ns_per_op;
+        uint64_t iterations;
+};
+
+// Runs `op` in batches until `min_time` has passed, reports the median
+// batch so a stray context switch does not skew the result
+static result_t measure(const function<void()> &op, double min_time)
+{
+        // Warm up caches and lazily allocated buffers
+        op();
+
+        // Size batches to roughly a millisecond each
+        uint64_t batch = 1;
+        while (true) {
+                auto start = steady_clock::now();
+                for (uint64_t i = 0; i < batch; ++i)
+                        op();
+                if (steady_clock::now() - start >= milliseconds(1) || batch >= (1u << 20))
+                        break;
+                batch *= 2;
+        }
+
+        vector<double> samples;
+        uint64_t iterations = 0;
+        auto begin = steady_clock::now();
+        while (samples.size() < 5
+                || duration<double>(steady_clock::now() - begin).count() < min_time) {
+                auto start = steady_clock::now();
+                for (uint64_t i = 0; i < batch; ++i)
+                        op();
+                samples.push_back(duration<double, nano>(
+                        steady_clock::now() - start).count() / batch);
+                iterations += batch;
+        }
+
+        sort(samples.begin(), samples.end());
+        return {samples[samples.size() / 2], iterations};
+}
+
+// A frame of the same test pattern the end-to-end benchmark uses
+static cv::Mat pattern(const cv::Size &s, uint noise)
+{
+        json j = {
+                {"width", (uint) s.width},
+                {"height", (uint) s.height},
+                {"fps", 0},
+                {"noise", noise}
+        };
+        zmqls::server::pattern_source src{zmqls::json::wrapper::basic(j)};
+
+        cv::Mat m;
+        if (src.open(cerr, "zmqls_microbench", false))
+                src.read(m);
+
+        return m;
+}
+
+static string size_name(const cv::Size &s)
+{
+        return to_string(s.width) + "x" + to_string(s.height);
+}
+
+int main(int argc, char **argv)
+{
+        bool help = false;
+        string filter, output, baseline;
+        double min_time = 0.2, tolerance = 0.1;
+        uint noise = 8;
+
+        cxxopts::Options opt("zmqls_microbench",
+                "Micro-benchmarks of the zmqls per-frame hot paths");
+        opt.add_options()
+                ("help", "Print help message", cxxopts::value(help))
+                ("filter", "Only run benchmarks whose name contains this",
+                        cxxopts::value(filter))
+                ("min-time", "Minimum measured time per benchmark in seconds",
+                        cxxopts::value(min_time)->default_value("0.2"))
+                ("noise", "Noise amplitude of the test pattern",
+                        cxxopts::value(noise)->default_value("8"))
+                ("o,output", "Write results here instead of stdout",
+                        cxxopts::value(output))
+                ("baseline", "Compare against the results in this file",
+                        cxxopts::value(baseline))
+                ("tolerance", "Slowdown relative to the baseline that fails (0.1 is 10%)",
+                        cxxopts::value(tolerance)->default_value("0.1"));
+
+        try {
+                opt.parse(argc, argv);
+        } catch (const cxxopts::OptionParseException &e) {
+                cerr << "zmqls_microbench: " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+        if (help) {
+                cout << opt.help();
+                return EXIT_SUCCESS;
+        }
+        // Before spending minutes on benchmarks it could not compare
+        if (!baseline.empty() && !ifstream(baseline)) {
+                cerr << "zmqls_microbench: No baseline at " << baseline 
+                        << ", record one first (make microbench_baseline)" << endl;
+                return EXIT_FAILURE;
+        }
+
+        vector<pair<string, function<void()>>> cases;
+        auto add = [&cases](const string &name, const function<void()> &op) {
+                cases.emplace_back(name, op);
+        };
+
+        // Message construction at typical encoded frame sizes
+        const string prefix = "camera";
+        for (size_t sz : {64u << 10, 1u << 20, 4u << 20}) {
+                auto data = make_shared<vector<uint8_t>>(sz, 0x55);
+                string kb = to_string(sz >> 10) + "k";
+
+                add("data_to_msg/copy/" + kb, [=]{
+                        zmq::message_t m;
+                        zmqls::data_to_msg(m, prefix, *data);
+                });
+                add("data_to_msg/zero_copy/" + kb, [=]{
+                        zmq::message_t m;
+                        zmqls::data_to_msg(m, data);
+                });
+        }
+        auto msg = make_shared<zmq::message_t>(1024);
+        add("get_beg", [=]{
+                volatile uint8_t *p = zmqls::get_beg(*msg, prefix);
+                (void) p;
+        });
+
+        // Frames at the sizes streams actually run at
+        const vector<cv::Size> sizes = {
+                {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}
+        };
+        for (const auto &s : sizes) {
+                auto frame = make_shared<cv::Mat>(pattern(s, noise));
+                if (frame->empty())
+                        continue;
+                string sn = size_name(s);
+
+                auto raw = make_shared<vector<uint8_t>>();
+                add("image_to_data/" + sn, [=]{
+                        zmqls::image_to_data(*raw, *frame);
+                });
+
+                for (int q : {50, 80, 95}) {
+                        vector<int> params = {cv::IMWRITE_JPEG_QUALITY, q};
+                        auto encoded = make_shared<vector<uint8_t>>();
+                        cv::imencode(".jpg", *frame, *encoded, params);
+                        string qn = "q" + to_string(q);
+
+                        add("jpeg_encode/" + sn + "/" + qn, [=]{
+                                cv::imencode(".jpg", *frame, *encoded, params);
+                        });
+
+                        auto in = make_shared<vector<uint8_t>>(*encoded);
+                        add("jpeg_decode/" + sn + "/" + qn, [=]{
+                                cv::imdecode(cv::Mat(*in), cv::IMREAD_COLOR);
+                        });
+                        add("jpeg_decode_reduced_4/" + sn + "/" + qn, [=]{
+                                cv::imdecode(cv::Mat(*in), cv::IMREAD_REDUCED_COLOR_4);
+                        });
+                }
+
+                // Every codec at its default settings, through the same
+                // interface the streams use
+                for (const auto &name : zmqls::codec_names()) {
+                        shared_ptr<zmqls::codec> c = zmqls::make_codec(
+                                name, zmqls::json::wrapper::basic());
+                        auto encoded = make_shared<zmqls::buffer_t>();
+                        c->encode(*frame, *encoded);
+
+                        add("codec_encode/" + name + "/" + sn, [=]{
+                                zmqls::buffer_t out;
+                                c->encode(*frame, out);
+                        });
+                        add("codec_decode/" + name + "/" + sn, [=]{
+                                cv::Mat m;
+                                c->decode(encoded->data(), encoded->size(), 
+                                        frame->size(), cv::IMREAD_COLOR, m);
+                        });
+                }
+
+                // JPEG backends and options side by side (without TurboJPEG
+                // they all go through OpenCV)
+                const vector<pair<string, json>> jpegs = {
+                        {"opencv", {{"backend", "opencv"}}},
+                        {"turbo", {{"backend", "turbo"}}},
+                        {"turbo_444", {{"backend", "turbo"}, {"subsampling", "444"}}},
+                        {"turbo_fast", {{"backend", "turbo"}, {"fast_dct", true}}}
+                };
+                for (const auto &jpeg : jpegs) {
+                        shared_ptr<zmqls::codec> c = zmqls::make_codec(
+                                "jpeg", zmqls::json::wrapper::basic(jpeg.second));
+                        auto encoded = make_shared<zmqls::buffer_t>();
+                        c->encode(*frame, *encoded);
+
+                        add("jpeg_encode/" + jpeg.first + "/" + sn, [=]{
+                                zmqls::buffer_t out;
+                                c->encode(*frame, out);
+                        });
+                        add("jpeg_decode_reduced_4/" + jpeg.first + "/" + sn, [=]{
+                                cv::Mat m;
+                                c->decode(encoded->data(), encoded->size(), 
+                                        frame->size(), cv::IMREAD_REDUCED_COLOR_4, m);
+                        });
+                }
+
+                // Each client transform on its own, and all of them fused
+                // (sizes have to be unsigned JSON numbers)
+                uint hw = s.width / 2, hh = s.height / 2;
+                const vector<pair<string, json>> transforms = {
+                        {"gamma", {{"gamma", 0.8}}},
+                        {"flip", {{"flip", "h"}}},
+                        {"rotate", {{"angle", 30}}},
+                        {"resize_half", {{"width", hw}, {"height", hh}}},
+                        {"all", {{"width", hw}, {"height", hh},
+                                {"flip", "hv"}, {"angle", 30}, {"gamma", 0.8}}}
+                };
+                for (const auto &t : transforms) {
+                        auto chain = make_shared<zmqls::transform>(
+                                zmqls::json::wrapper::basic(t.second));
+                        add("transform/" + t.first + "/" + sn, [=]{
+                                cv::Mat out;
+                                chain->apply(*frame, out);
+                        });
+                }
+        }
+
+        json results = json::object();
+        for (const auto &c : cases) {
+                if (!filter.empty() && c.first.find(filter) == string::npos)
+                        continue;
+
+                auto r = measure(c.second, min_time);
+                results[c.first] = {
+                        {"ns_per_op", r.ns_per_op},
+                        {"iterations", r.iterations}
+                };
+                cerr << "zmqls_microbench: " << c.first << ": "
+                        << r.ns_per_op << " ns/op" << endl;
+        }
+
+        if (output.empty()) {
+                cout << results.dump(2) << endl;
+        } else {
+                ofstream out(output);
+                out << results.dump(2) << endl;
+        }
+
+        // Fail on any benchmark that got slower than the baseline allows
+        if (baseline.empty())
+                return EXIT_SUCCESS;
+
+        json base;
+        try {
+                ifstream in(baseline);
+                in >> base;
+        } catch (const json::parse_error &e) {
+                cerr << "zmqls_microbench: Failed to parse baseline: "
+                        << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+
+        int regressions = 0;
+        for (auto it = results.begin(); it != results.end(); ++it) {
+                auto b = base.find(it.key());
+                if (b == base.end() || !b->contains("ns_per_op"))
+                        continue;
+
+                double was = (*b)["ns_per_op"].get<double>();
+                double now = (*it)["ns_per_op"].get<double>();
+                if (was > 0 && now > was * (1 + tolerance)) {
+                        cerr << "zmqls_microbench: REGRESSION " << it.key()
+                                << ": " << was << " -> " << now << " ns/op (+"
+                                << (now / was - 1) * 100 << "%)" << endl;
+                        ++regressions;
+                }
+        }
+
+        return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
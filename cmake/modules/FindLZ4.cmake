@@ -0,0 +1,26 @@
+# - Try to find the lz4 compression library
+#
+# Variables defined by this module:
+#
+#  LZ4_FOUND              System has lz4 libs/headers
+#  LZ4_LIBRARY            The lz4 library
+#  LZ4_INCLUDE_DIR        The location of the lz4 headers
+
+find_path(LZ4_INCLUDE_DIR
+  NAMES lz4.h
+  )
+
+find_library(LZ4_LIBRARY
+  NAMES lz4 liblz4
+  )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(
+  LZ4
+  REQUIRED_VARS LZ4_LIBRARY LZ4_INCLUDE_DIR
+  )
+
+mark_as_advanced(
+  LZ4_INCLUDE_DIR
+  LZ4_LIBRARY
+  )
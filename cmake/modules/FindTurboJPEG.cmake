@@ -0,0 +1,26 @@
+# - Try to find the TurboJPEG library of libjpeg-turbo
+#
+# Variables defined by this module:
+#
+#  TurboJPEG_FOUND              System has TurboJPEG libs/headers
+#  TurboJPEG_LIBRARY            The TurboJPEG library
+#  TurboJPEG_INCLUDE_DIR        The location of the TurboJPEG headers
+
+find_path(TurboJPEG_INCLUDE_DIR
+  NAMES turbojpeg.h
+  )
+
+find_library(TurboJPEG_LIBRARY
+  NAMES turbojpeg libturbojpeg
+  )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(
+  TurboJPEG
+  REQUIRED_VARS TurboJPEG_LIBRARY TurboJPEG_INCLUDE_DIR
+  )
+
+mark_as_advanced(
+  TurboJPEG_INCLUDE_DIR
+  TurboJPEG_LIBRARY
+  )
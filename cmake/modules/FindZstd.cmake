@@ -0,0 +1,26 @@
+# - Try to find the zstd compression library
+#
+# Variables defined by this module:
+#
+#  Zstd_FOUND              System has zstd libs/headers
+#  Zstd_LIBRARY            The zstd library
+#  Zstd_INCLUDE_DIR        The location of the zstd headers
+
+find_path(Zstd_INCLUDE_DIR
+  NAMES zstd.h
+  )
+
+find_library(Zstd_LIBRARY
+  NAMES zstd libzstd
+  )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(
+  Zstd
+  REQUIRED_VARS Zstd_LIBRARY Zstd_INCLUDE_DIR
+  )
+
+mark_as_advanced(
+  Zstd_INCLUDE_DIR
+  Zstd_LIBRARY
+  )
@@ -0,0 +1,45 @@
+#ifndef ZMQLS_CHANGE_H
+#define ZMQLS_CHANGE_H
+
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        // Cheap test of whether a frame is worth sending: it is shrunk to 
+        // a thumbnail `width` pixels wide and compared against the 
+        // thumbnail of the last frame that was. Both steps are vectorised
+        // by OpenCV and only touch a few thousand pixels after the resize.
+        class change_detector {
+        public:
+                // `threshold` is the mean absolute difference per channel 
+                // (0 to 255) that counts as a change, and after `max_skip` 
+                // unchanged frames in a row the next one counts as changed 
+                // regardless (0 means never)
+                change_detector(uint width, double threshold, uint max_skip):
+                        m_width(width ? width : 1), m_threshold(threshold), 
+                        m_max_skip(max_skip) { }
+
+                // True if the frame should be sent, in which case it 
+                // becomes the new reference
+                bool changed(const ::cv::Mat &frame);
+                // The next frame counts as changed, whatever it is
+                void reset() { this->m_reset = true; }
+
+                // Difference found by the last call to changed()
+                double difference() const { return this->m_difference; }
+        private:
+                uint m_width;
+                double m_threshold;
+                uint m_max_skip;
+                uint m_skipped = 0;
+                bool m_reset = true;
+                double m_difference = 0;
+                ::cv::Mat m_reference;
+                ::cv::Mat m_thumb;
+        };
+}
+
+#endif // ZMQLS_CHANGE_H
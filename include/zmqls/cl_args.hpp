@@ -36,10 +36,21 @@
 #define ZMQLS_SERVER_THREADS_DEF        ZMQLS_COMMON_THREADS_DEF
 #define ZMQLS_SERVER_FILE_DEF           ZMQLS_COMMON_FILE_DEF
 
+// Relay argument descriptions
+#define ZMQLS_RELAY_NAME                "zmqls-relay"
+#define ZMQLS_RELAY_DESC                "Passes video from ZMQLS servers or relays on to many clients"
+#define ZMQLS_RELAY_HELP_DESC           ZMQLS_COMMON_HELP_DESC
+#define ZMQLS_RELAY_THREADS_DESC        ZMQLS_COMMON_THREADS_DESC
+#define ZMQLS_RELAY_FILE_DESC           ZMQLS_COMMON_FILE_DESC
+
+// Relay default arguments
+#define ZMQLS_RELAY_THREADS_DEF         ZMQLS_COMMON_THREADS_DEF
+#define ZMQLS_RELAY_FILE_DEF            ZMQLS_COMMON_FILE_DEF
+
 namespace zmqls {
         struct cl_args {
                 typedef enum {
-                        CLIENT, SERVER
+                        CLIENT, SERVER, RELAY
                 } model;
 
                 const char *name;
@@ -56,29 +67,30 @@ namespace zmqls {
 
                 cl_args() = delete;
                 cl_args(const model &m):
-                        name((m == CLIENT)
-                                ? ZMQLS_CLIENT_NAME : ZMQLS_SERVER_NAME),
-                        desc((m == CLIENT)
-                                ? ZMQLS_CLIENT_DESC : ZMQLS_SERVER_DESC),
-                        help_desc((m == CLIENT)
-                                ? ZMQLS_CLIENT_HELP_DESC
-                                : ZMQLS_SERVER_HELP_DESC),
-                        threads_desc((m == CLIENT)
-                                ? ZMQLS_CLIENT_THREADS_DESC 
-                                : ZMQLS_SERVER_THREADS_DESC),
-                        file_desc((m == CLIENT) 
-                                ? ZMQLS_CLIENT_FILE_DESC 
-                                : ZMQLS_SERVER_FILE_DESC),
-                        threads_def((m == CLIENT) 
-                                ? ZMQLS_CLIENT_THREADS_DEF 
-                                : ZMQLS_SERVER_THREADS_DEF),
-                        file_def((m == CLIENT)
-                                ? ZMQLS_CLIENT_FILE_DEF
-                                : ZMQLS_SERVER_FILE_DEF) { }
+                        name(pick(m, ZMQLS_CLIENT_NAME, 
+                                ZMQLS_SERVER_NAME, ZMQLS_RELAY_NAME)),
+                        desc(pick(m, ZMQLS_CLIENT_DESC, 
+                                ZMQLS_SERVER_DESC, ZMQLS_RELAY_DESC)),
+                        help_desc(pick(m, ZMQLS_CLIENT_HELP_DESC,
+                                ZMQLS_SERVER_HELP_DESC, ZMQLS_RELAY_HELP_DESC)),
+                        threads_desc(pick(m, ZMQLS_CLIENT_THREADS_DESC, 
+                                ZMQLS_SERVER_THREADS_DESC, ZMQLS_RELAY_THREADS_DESC)),
+                        file_desc(pick(m, ZMQLS_CLIENT_FILE_DESC, 
+                                ZMQLS_SERVER_FILE_DESC, ZMQLS_RELAY_FILE_DESC)),
+                        threads_def(pick(m, ZMQLS_CLIENT_THREADS_DEF, 
+                                ZMQLS_SERVER_THREADS_DEF, ZMQLS_RELAY_THREADS_DEF)),
+                        file_def(pick(m, ZMQLS_CLIENT_FILE_DEF,
+                                ZMQLS_SERVER_FILE_DEF, ZMQLS_RELAY_FILE_DEF)) { }
 
                 int parse(int argc, char **argv);
         private:
                 cxxopts::Options add_options();
+
+                static const char *pick(const model &m, const char *client, 
+                        const char *server, const char *relay)
+                {
+                        return (m == CLIENT) ? client : (m == SERVER) ? server : relay;
+                }
         };
 }
 
@@ -1,18 +1,131 @@
 #ifndef ZMQLS_CLIENT_H
 #define ZMQLS_CLIENT_H
 
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <json/json.hpp>
+#include <opencv2/opencv.hpp>
 #include <zmq.hpp>
 
 #include <zmqls/stream.hpp>
+#include <zmqls/queue.hpp>
+#include <zmqls/histogram.hpp>
+#include <zmqls/codec.hpp>
+#include <zmqls/shm.hpp>
 
 namespace zmqls {
         namespace client {
                 using base_stream_t = ::zmqls::stream;
 
+                // Only the newest frame is ever kept between stages
+                using message_queue_t = ::zmqls::bounded_queue<::std::vector<::zmq::message_t>>;
+                using image_queue_t = ::zmqls::bounded_queue<::cv::Mat>;
+
+                // Shows the newest frame of every attached stream. HighGUI
+                // is not thread-safe, so all windows are driven from the
+                // single thread calling run().
+                class display {
+                public:
+                        // Returns the slot the stream should put frames in,
+                        // time spent showing its frames goes into `shown_us`
+                        image_queue_t &attach(base_stream_t &s,
+                                ::zmqls::histogram *shown_us = nullptr);
+                        void detach(base_stream_t &s);
+
+                        // Shows frames until escape is pressed (which stops
+                        // every attached stream) or close() is called
+                        // Returns true if escape was pressed
+                        bool run();
+                        void close() { this->m_closed = true; }
+                private:
+                        struct entry_t {
+                                base_stream_t *stream;
+                                ::std::unique_ptr<image_queue_t> slot;
+                                ::zmqls::histogram *shown_us;
+                                bool shown;
+                        };
+
+                        ::std::list<entry_t> m_entries;
+                        ::std::mutex m_mutex;
+                        ::std::atomic<bool> m_closed{false};
+                };
+
+                // Counters and timings (in microseconds) of one stream
+                struct stats_t {
+                        ::std::atomic<uint64_t> frames{0};
+                        ::std::atomic<uint64_t> bytes{0};
+                        // Frames the server sent that never arrived
+                        ::std::atomic<uint64_t> lost{0};
+                        // Times the server's stream started over
+                        ::std::atomic<uint64_t> resets{0};
+                        // Frames replaced by newer ones before they were 
+                        // decoded, and before they were displayed
+                        ::std::atomic<uint64_t> stale_received{0};
+                        ::std::atomic<uint64_t> stale_decoded{0};
+                        // Frames that failed to decode
+                        ::std::atomic<uint64_t> errors{0};
+                        // Headers sent instead of unchanged frames
+                        ::std::atomic<uint64_t> keepalives{0};
+                        // Tiled frames whose keyframe never arrived
+                        ::std::atomic<uint64_t> unanchored{0};
+                        // Frames in shared memory that were overwritten 
+                        // before they were decoded
+                        ::std::atomic<uint64_t> overrun{0};
+                        // Encoded on the server to received here
+                        ::zmqls::histogram receive;
+                        ::zmqls::histogram decode;
+                        ::zmqls::histogram transform;
+                        ::zmqls::histogram display;
+                        // Capture to decoded and transformed (or received,
+                        // when not decoding)
+                        ::zmqls::histogram latency;
+                        // CPU time of each stage, added as its threads end
+                        ::std::atomic<int64_t> receive_cpu_us{0};
+                        ::std::atomic<int64_t> decode_cpu_us{0};
+                };
+
                 class stream : public base_stream_t {
                 public:
-                        using base_stream_t::base_stream_t;
+                        stream(const ::nlohmann::json &j, display &d):
+                                base_stream_t(j), m_display(d) { }
                         int start(::zmq::context_t &ctx);
+
+                        const stats_t &stats() const { return this->m_stats; }
+                        // Snapshot of the stats, as served by the metrics endpoint
+                        ::nlohmann::json metrics() const;
+
+                        // Headless streams ("sink": "headless") never open a
+                        // window, they only receive, decode and measure
+                        static bool headless(const ::nlohmann::json &j)
+                        {
+                                auto it = j.find("sink");
+                                return it != j.end() && it->is_string() 
+                                        && it->get<::std::string>() == "headless";
+                        }
+                private:
+                        display &m_display;
+                        stats_t m_stats;
+
+                        // The last keyframe received, kept aside since a
+                        // newer frame may replace it before it is decoded
+                        ::std::mutex m_key_mutex;
+                        ::zmq::message_t m_key;
+                        uint64_t m_key_seq = 0;
+
+                        ::std::vector<::std::unique_ptr<codec>> m_decoders;
+
+                        // Frames are read from the shared memory `shm` if
+                        // it is not empty, the messages only point to them
+                        void receive(::zmq::socket_t &sub, const string_t &topic, 
+                                const string_t &shm, message_queue_t &out, bool decode);
+                        void print_stats(::std::ostream &os, double fps, double bps);
                 };
         }
 }
@@ -0,0 +1,88 @@
+#ifndef ZMQLS_CODEC_H
+#define ZMQLS_CODEC_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.hpp>
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+#include <zmqls/header.hpp>
+#include <zmqls/histogram.hpp>
+
+namespace zmqls {
+        // Turns frames into payloads and back. The codec's id travels in
+        // every frame header, so clients pick the matching decoder by
+        // themselves. Every call is timed, and the bytes going in and
+        // out are counted, so codecs can be compared per link.
+        class codec {
+        public:
+                using json_t = ::zmqls::json::wrapper::basic;
+
+                // Largest width or height decode() accepts. Sizes come off
+                // the network, bigger ones are taken for broken frames 
+                // rather than allocated for.
+                static constexpr int MAX_SIDE = 1 << 14;
+
+                virtual ~codec() = default;
+
+                virtual codec_id id() const = 0;
+                virtual const char *name() const = 0;
+                // What goes into the header's quality field
+                virtual uint quality() const { return 0; }
+
+                // Replaces the contents of `out`, returns false on failure
+                bool encode(const ::cv::Mat &in, buffer_t &out);
+                // `size` is the frame's size as given in its header (false
+                // if it is empty or above MAX_SIDE), `flags` are cv::imdecode
+                // flags, which codecs that cannot reduce while decoding ignore
+                bool decode(const uint8_t *d, ::std::size_t sz,
+                        const ::cv::Size &size, int flags, ::cv::Mat &out);
+
+                // Encode/decode times (microseconds) and compression ratio
+                ::nlohmann::json metrics() const;
+        protected:
+                virtual bool do_encode(const ::cv::Mat &in, buffer_t &out) const = 0;
+                virtual bool do_decode(const uint8_t *d, ::std::size_t sz,
+                        const ::cv::Size &size, int flags, ::cv::Mat &out) const = 0;
+        private:
+                ::zmqls::histogram m_encode;
+                ::zmqls::histogram m_decode;
+                ::std::atomic<uint64_t> m_raw_bytes{0};
+                ::std::atomic<uint64_t> m_encoded_bytes{0};
+        };
+
+        // Builds the codec called `name` ("jpeg", "raw", "png", "webp",
+        // "raw+lz4" or "raw+zstd") with the settings in `j`: "encode"
+        // (quality for jpeg and webp, compression level for png and zstd,
+        // acceleration for lz4). Built with TurboJPEG, jpeg also takes
+        // "backend" ("turbo", the default, or "opencv"), "subsampling" 
+        // ("444", "422", "420", the default, "440", "411" or "gray") and 
+        // "fast_dct". Returns nullptr for unknown codecs or settings and
+        // codecs this build has no library for.
+        ::std::unique_ptr<codec> make_codec(const ::std::string &name,
+                const codec::json_t &j);
+        // A codec for decoding frames of `id`, settings as above
+        ::std::unique_ptr<codec> make_codec(codec_id id, 
+                const codec::json_t &j = codec::json_t());
+        // Names of every codec this build supports
+        ::std::vector<::std::string> codec_names();
+        // The settings above out of a stream's JSON, those of `layer`
+        // (one of its "layers") taking precedence
+        ::nlohmann::json codec_settings(const codec::json_t &stream, 
+                const ::nlohmann::json *layer = nullptr);
+
+        // Size of a JPEG image as given by its frame (SOF) marker, without
+        // decoding it. Empty if `d` does not look like a JPEG image.
+        ::cv::Size jpeg_size(const uint8_t *d, ::std::size_t sz);
+        // Chroma subsampling of a JPEG image as named by the "subsampling"
+        // setting, empty if it is none of those or not a JPEG image
+        ::std::string jpeg_subsampling(const uint8_t *d, ::std::size_t sz);
+}
+
+#endif // ZMQLS_CODEC_H
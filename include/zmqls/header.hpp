@@ -0,0 +1,150 @@
+#ifndef ZMQLS_HEADER_H
+#define ZMQLS_HEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        // How the payload of a frame is encoded
+        enum class codec_id : uint8_t {
+                UNKNOWN = 0,
+                JPEG = 1,
+                // Pixel rows as they are, BGR
+                RAW = 2,
+                PNG = 3,
+                WEBP = 4,
+                // Raw, compressed, see codec.hpp
+                RAW_LZ4 = 5,
+                RAW_ZSTD = 6
+        };
+
+        // Bits of frame_header::flags
+        enum frame_flags : uint8_t {
+                // Nothing changed since the last frame sent, the payload 
+                // is empty and the client keeps showing what it has
+                FLAG_KEEPALIVE = 1 << 0,
+                // A whole frame that later tiled frames are relative to
+                FLAG_KEYFRAME = 1 << 1,
+                // The payload is a tile table followed by the tiles that
+                // differ from the keyframe, see tile_table
+                FLAG_TILED = 1 << 2
+        };
+
+        // Per-frame metadata, sent as its own part between the prefix and 
+        // the payload. On the wire it is a fixed-size little-endian record:
+        //
+        //   offset  size  field
+        //        0     1  version
+        //        1     1  codec
+        //        2     1  flags
+        //        3     1  reserved, 0
+        //        4     4  quality
+        //        8     4  width
+        //       12     4  height
+        //       16     8  seq
+        //       24     8  capture_us
+        //       32     8  encode_us
+        //       40     8  stream_id
+        //
+        // Timestamps are wall-clock microseconds since the epoch, so 
+        // latencies measured across hosts are only as good as their clock 
+        // synchronisation.
+        //
+        // seq counts from 0 every time a server stream starts, stream_id 
+        // tells those runs apart.
+        struct frame_header {
+                static constexpr uint8_t VERSION = 1;
+                static constexpr std::size_t SIZE = 48;
+
+                uint8_t version = VERSION;
+                codec_id codec = codec_id::UNKNOWN;
+                uint32_t quality = 0;
+                uint8_t flags = 0;
+                uint32_t width = 0;
+                uint32_t height = 0;
+                uint64_t seq = 0;
+                int64_t capture_us = 0;
+                int64_t encode_us = 0;
+                uint64_t stream_id = 0;
+        };
+
+        // A stream_id for a server stream starting now, never 0
+        uint64_t new_stream_id();
+
+        // Start of the payload of a tiled frame, followed by the encoded 
+        // tiles back to back in the same order:
+        //
+        //   offset  size  field
+        //        0     8  key_seq, seq of the keyframe tiles replace parts of
+        //        8     2  tile_width
+        //       10     2  tile_height
+        //       12     4  count
+        //       16   8*n  col (2), row (2) and size (4) of every tile
+        //
+        // Tiles at the right and bottom edges are cut to the frame size.
+        // Parts of the keyframe no tile covers are shown as they were in 
+        // the keyframe.
+        struct tile_table {
+                struct tile_t {
+                        uint16_t col = 0;
+                        uint16_t row = 0;
+                        uint32_t size = 0;
+                        // Where the tile starts in the payload, not sent
+                        std::size_t offset = 0;
+                };
+
+                uint64_t key_seq = 0;
+                uint16_t tile_width = 0;
+                uint16_t tile_height = 0;
+                std::vector<tile_t> tiles;
+
+                static std::size_t size(std::size_t count) { return 16 + 8 * count; }
+        };
+
+        // Writes the table to the first tile_table::size() bytes of `d`
+        void write_tile_table(uint8_t *d, const tile_table &t);
+        // Returns false unless the table and every tile fit in `d_sz`
+        bool parse_tile_table(const uint8_t *d, const std::size_t &d_sz, tile_table &t);
+
+        // Payload of a shared memory notification, which is sent as 
+        // [prefix][header][shm_ref] in place of the frame (keep-alives 
+        // have an empty payload as usual):
+        //
+        //   offset  size  field
+        //        0     8  ring, the id of the shm_ring the frame is in
+        //        8     8  pos, the frame's position in it
+        struct shm_ref {
+                static constexpr std::size_t SIZE = 16;
+
+                uint64_t ring = 0;
+                uint64_t pos = 0;
+        };
+
+        std::size_t shm_ref_to_msg(zmq::message_t &m, const shm_ref &r);
+        bool parse_shm_ref(const zmq::message_t &m, shm_ref &r);
+
+        // Current wall-clock time as used in frame headers
+        int64_t now_us();
+
+        std::size_t header_to_msg(zmq::message_t &m, const frame_header &h);
+        // Returns false if the message is not a header this version understands
+        bool parse_header(const zmq::message_t &m, frame_header &h);
+        bool parse_header(const uint8_t *d, const std::size_t &d_sz, frame_header &h);
+
+        // What frames of `prefix` go out under: the prefix and a NUL, so 
+        // a subscription to it matches no other prefix starting with it
+        std::string topic(const std::string &prefix);
+
+        // Sends [prefix][header][data] as one multipart message, 
+        // without copying data (a null buffer sends an empty part)
+        bool send_frame(zmq::socket_t &s, const std::string &p, 
+                const frame_header &h, const buffer_ptr_t &d);
+}
+
+#endif // ZMQLS_HEADER_H
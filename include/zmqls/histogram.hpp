@@ -0,0 +1,135 @@
+#ifndef ZMQLS_HISTOGRAM_H
+#define ZMQLS_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        // Log-linear (HDR-style) histogram of non-negative integer values,
+        // e.g. microseconds. Every power of two is split into SUB_BUCKETS
+        // linear buckets, so any recorded value is off by at most ~6%.
+        // Recording is a couple of relaxed atomic increments, which lets
+        // any number of threads record while another one reads.
+        class histogram {
+        public:
+                static constexpr int SUB_BITS = 4;
+                static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+                static constexpr int MAGNITUDES = 64 - SUB_BITS + 1;
+                static constexpr int BUCKETS = MAGNITUDES * SUB_BUCKETS;
+
+                histogram() { this->reset(); }
+                histogram(const histogram &) = delete;
+                histogram &operator=(const histogram &) = delete;
+
+                void record(int64_t v)
+                {
+                        uint64_t u = v < 0 ? 0 : (uint64_t) v;
+                        this->m_counts[index(u)].fetch_add(1, ::std::memory_order_relaxed);
+                        this->m_count.fetch_add(1, ::std::memory_order_relaxed);
+                        this->m_sum.fetch_add(u, ::std::memory_order_relaxed);
+
+                        uint64_t max = this->m_max.load(::std::memory_order_relaxed);
+                        while (u > max && !this->m_max.compare_exchange_weak(
+                                max, u, ::std::memory_order_relaxed))
+                                ;
+                }
+
+                uint64_t count() const { return this->m_count.load(::std::memory_order_relaxed); }
+                uint64_t max() const { return this->m_max.load(::std::memory_order_relaxed); }
+                double mean() const
+                {
+                        uint64_t n = this->count();
+                        return n ? (double) this->m_sum.load(::std::memory_order_relaxed) / n : 0;
+                }
+
+                // Value at or below which the given fraction (0 to 1) of
+                // recorded values fall, reported as its bucket's upper bound
+                uint64_t percentile(double p) const
+                {
+                        uint64_t n = this->count();
+                        if (n == 0)
+                                return 0;
+
+                        uint64_t rank = (uint64_t) (p * n + 0.5);
+                        if (rank < 1)
+                                rank = 1;
+
+                        uint64_t seen = 0;
+                        for (int i = 0; i < BUCKETS; ++i) {
+                                seen += this->m_counts[i].load(::std::memory_order_relaxed);
+                                if (seen >= rank) {
+                                        uint64_t top = upper(i);
+                                        return top < this->max() ? top : this->max();
+                                }
+                        }
+
+                        return this->max();
+                }
+
+                // Adds every value recorded in another histogram to this one
+                void merge(const histogram &h)
+                {
+                        for (int i = 0; i < BUCKETS; ++i) {
+                                this->m_counts[i].fetch_add(
+                                        h.m_counts[i].load(::std::memory_order_relaxed), 
+                                        ::std::memory_order_relaxed);
+                        }
+                        this->m_count.fetch_add(h.count(), ::std::memory_order_relaxed);
+                        this->m_sum.fetch_add(
+                                h.m_sum.load(::std::memory_order_relaxed), 
+                                ::std::memory_order_relaxed);
+
+                        uint64_t v = h.max();
+                        uint64_t max = this->m_max.load(::std::memory_order_relaxed);
+                        while (v > max && !this->m_max.compare_exchange_weak(
+                                max, v, ::std::memory_order_relaxed))
+                                ;
+                }
+
+                void reset()
+                {
+                        for (auto &c : this->m_counts)
+                                c.store(0, ::std::memory_order_relaxed);
+                        this->m_count.store(0, ::std::memory_order_relaxed);
+                        this->m_sum.store(0, ::std::memory_order_relaxed);
+                        this->m_max.store(0, ::std::memory_order_relaxed);
+                }
+        private:
+                ::std::array<::std::atomic<uint64_t>, BUCKETS> m_counts;
+                ::std::atomic<uint64_t> m_count;
+                ::std::atomic<uint64_t> m_sum;
+                ::std::atomic<uint64_t> m_max;
+
+                // Values below SUB_BUCKETS get a bucket each, above that the
+                // magnitude picks a row and the next SUB_BITS bits a column
+                static int index(uint64_t v)
+                {
+                        if (v < (uint64_t) SUB_BUCKETS)
+                                return (int) v;
+
+                        int msb = 63 - __builtin_clzll(v);
+                        int shift = msb - SUB_BITS;
+                        int sub = (int) (v >> shift) - SUB_BUCKETS;
+
+                        return (shift + 1) * SUB_BUCKETS + sub;
+                }
+
+                // Largest value that lands in bucket i
+                static uint64_t upper(int i)
+                {
+                        if (i < SUB_BUCKETS)
+                                return (uint64_t) i;
+
+                        int shift = i / SUB_BUCKETS - 1;
+                        uint64_t sub = (uint64_t) (i % SUB_BUCKETS) + SUB_BUCKETS;
+
+                        return ((sub + 1) << shift) - 1;
+                }
+        };
+}
+
+#endif // ZMQLS_HISTOGRAM_H
@@ -0,0 +1,90 @@
+#ifndef ZMQLS_HUB_H
+#define ZMQLS_HUB_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        namespace server {
+                // Captures from many devices on a single thread instead of
+                // one blocked thread per device. cv::VideoCapture::waitAny
+                // grabs from whichever devices have a frame ready, which 
+                // are all stamped with the same grab time, so frames from
+                // different cameras can be lined up. Only the V4L2 backend
+                // supports this. Frames are retrieved (decoded) on a thread
+                // of each device's own, and the hub leaves a device out of
+                // its waits until that is done.
+                class capture_hub {
+                public:
+                        // Called on the device's own thread with the device 
+                        // once it has grabbed a frame (to be retrieved right 
+                        // there), and with nullptr at least every 100 ms 
+                        // otherwise. Must not add or remove devices.
+                        using callback_t = ::std::function<void(
+                                ::cv::VideoCapture *device, ::std::int64_t grab_us)>;
+
+                        // The hub called `name`, shared by everyone asking 
+                        // for it while any of them holds on to it
+                        static ::std::shared_ptr<capture_hub> get(const ::std::string &name);
+
+                        capture_hub();
+                        ~capture_hub();
+
+                        // Returns an id for remove()
+                        ::std::uint64_t add(const ::cv::VideoCapture &device, 
+                                const callback_t &callback);
+                        // Returns once the callback is not running anymore
+                        void remove(::std::uint64_t id);
+
+                        // The devices' backend cannot wait on them
+                        bool failed() const { return this->m_failed; }
+                private:
+                        struct entry_t {
+                                ::std::uint64_t id;
+                                ::cv::VideoCapture device;
+                                callback_t callback;
+
+                                // Grabs are handed to the entry's thread here
+                                ::std::thread thread;
+                                ::std::mutex mutex;
+                                ::std::condition_variable wake;
+                                ::std::int64_t grab_us = 0;
+                                bool stopping = false;
+                                // Not to be waited on until retrieved from
+                                ::std::atomic<bool> busy{false};
+                        };
+                        using entry_ptr_t = ::std::unique_ptr<entry_t>;
+
+                        // Only the hub's thread touches the entries, the 
+                        // changes to them wait here until its next round
+                        ::std::vector<entry_ptr_t> m_entries;
+                        ::std::mutex m_mutex;
+                        ::std::condition_variable m_changed;
+                        ::std::vector<entry_ptr_t> m_added;
+                        ::std::set<::std::uint64_t> m_removed;
+                        ::std::uint64_t m_next_id = 0;
+                        ::std::atomic<bool> m_running{true};
+                        ::std::atomic<bool> m_failed{false};
+                        ::std::thread m_thread;
+
+                        void run();
+                        // The entry's own thread
+                        void serve(entry_t &e);
+                        void stop(entry_t &e);
+                };
+        }
+}
+
+#endif // ZMQLS_HUB_H
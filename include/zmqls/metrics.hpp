@@ -0,0 +1,60 @@
+#ifndef ZMQLS_METRICS_H
+#define ZMQLS_METRICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <json/json.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+#include <zmqls/histogram.hpp>
+
+namespace zmqls {
+        // Count, mean and tail percentiles of a histogram, in its own unit
+        ::nlohmann::json histogram_to_json(const histogram &h);
+
+        // Exports a stream's metrics as JSON from a thread of its own,
+        // either published periodically (PUB, as [topic][json]) or sent
+        // in reply to any request (REP). Configured by the "metrics"
+        // object of a stream:
+        //
+        //   "address":  endpoint to bind, required
+        //   "type":     "pub" (default) or "rep"
+        //   "interval": seconds between publications (default 1)
+        //   "topic":    PUB topic (default the stream's name)
+        class metrics_endpoint {
+        public:
+                using snapshot_t = ::std::function<::nlohmann::json()>;
+
+                explicit metrics_endpoint(const snapshot_t &snapshot):
+                        m_snapshot(snapshot) { }
+                ~metrics_endpoint() { this->stop(); }
+
+                // Binds and starts serving. Without a "metrics" object
+                // there is nothing to do, which is not an error.
+                bool start(::zmq::context_t &ctx,
+                        const ::zmqls::json::wrapper::basic &config,
+                        const ::std::string &name, ::std::ostream &err);
+                void stop();
+        private:
+                snapshot_t m_snapshot;
+                ::std::unique_ptr<::zmq::socket_t> m_socket;
+                ::std::thread m_thread;
+                ::std::mutex m_mutex;
+                ::std::condition_variable m_wake;
+                bool m_running = false;
+
+                void publish(const ::std::string &topic, double interval);
+                void reply();
+        };
+}
+
+#endif // ZMQLS_METRICS_H
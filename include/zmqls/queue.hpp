@@ -0,0 +1,156 @@
+#ifndef ZMQLS_QUEUE_H
+#define ZMQLS_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        // Bounded queue connecting two pipeline stages. When full, pushing
+        // drops the oldest element instead of blocking, so a slow consumer
+        // can never stall the producer (e.g. the camera).
+        template <typename T> class bounded_queue {
+        public:
+                using value_t = T;
+
+                bounded_queue() = delete;
+                explicit bounded_queue(::std::size_t capacity):
+                        m_capacity(capacity ? capacity : 1) { }
+                bounded_queue(const bounded_queue &) = delete;
+                bounded_queue &operator=(const bounded_queue &) = delete;
+
+                // Returns false if an element had to be dropped
+                bool push(value_t &&v)
+                {
+                        bool dropped = false;
+                        {
+                                ::std::lock_guard<::std::mutex> lock(this->m_mutex);
+                                if (this->m_closed)
+                                        return true;
+                                if (this->m_items.size() >= this->m_capacity) {
+                                        this->m_items.pop_front();
+                                        ++this->m_dropped;
+                                        dropped = true;
+                                }
+                                this->m_items.push_back(::std::move(v));
+                        }
+                        this->m_cv.notify_one();
+
+                        return !dropped;
+                }
+
+                // Blocks while the queue is full instead, for a producer 
+                // that is to be held back. Returns false if it was closed.
+                bool push_wait(value_t &&v)
+                {
+                        {
+                                ::std::unique_lock<::std::mutex> lock(this->m_mutex);
+                                this->m_not_full.wait(lock, [this]{
+                                        return this->m_closed 
+                                                || this->m_items.size() < this->m_capacity;
+                                });
+                                if (this->m_closed)
+                                        return false;
+                                this->m_items.push_back(::std::move(v));
+                        }
+                        this->m_cv.notify_one();
+
+                        return true;
+                }
+
+                // Blocks until consumers have taken every element, for a 
+                // producer that is to fetch its next one only on demand. 
+                // Returns false if the queue was closed.
+                bool wait_empty()
+                {
+                        ::std::unique_lock<::std::mutex> lock(this->m_mutex);
+                        this->m_not_full.wait(lock, [this]{
+                                return this->m_closed || this->m_items.empty();
+                        });
+
+                        return !this->m_closed;
+                }
+
+                // Blocks until an element is available or the queue is closed
+                // Returns false only once the queue is closed and drained
+                bool pop(value_t &v)
+                {
+                        ::std::unique_lock<::std::mutex> lock(this->m_mutex);
+                        this->m_cv.wait(lock, [this]{
+                                return this->m_closed || !this->m_items.empty();
+                        });
+
+                        return this->take(v);
+                }
+
+                // Like pop(), but gives up after the given timeout
+                template <typename Rep, typename Period>
+                bool pop_for(value_t &v, const ::std::chrono::duration<Rep, Period> &d)
+                {
+                        ::std::unique_lock<::std::mutex> lock(this->m_mutex);
+                        this->m_cv.wait_for(lock, d, [this]{
+                                return this->m_closed || !this->m_items.empty();
+                        });
+
+                        return this->take(v);
+                }
+
+                // Wakes up every waiting consumer, further pushes are ignored
+                void close()
+                {
+                        {
+                                ::std::lock_guard<::std::mutex> lock(this->m_mutex);
+                                this->m_closed = true;
+                        }
+                        this->m_cv.notify_all();
+                        this->m_not_full.notify_all();
+                }
+
+                bool closed() const
+                {
+                        ::std::lock_guard<::std::mutex> lock(this->m_mutex);
+                        return this->m_closed;
+                }
+
+                ::std::size_t size() const
+                {
+                        ::std::lock_guard<::std::mutex> lock(this->m_mutex);
+                        return this->m_items.size();
+                }
+
+                ::std::size_t dropped() const
+                {
+                        ::std::lock_guard<::std::mutex> lock(this->m_mutex);
+                        return this->m_dropped;
+                }
+
+                ::std::size_t capacity() const { return this->m_capacity; }
+        private:
+                const ::std::size_t m_capacity;
+                ::std::size_t m_dropped = 0;
+                bool m_closed = false;
+                ::std::deque<value_t> m_items;
+                mutable ::std::mutex m_mutex;
+                ::std::condition_variable m_cv;
+                ::std::condition_variable m_not_full;
+
+                // Caller must hold the lock
+                bool take(value_t &v)
+                {
+                        if (this->m_items.empty())
+                                return false;
+
+                        v = ::std::move(this->m_items.front());
+                        this->m_items.pop_front();
+                        this->m_not_full.notify_one();
+
+                        return true;
+                }
+        };
+}
+
+#endif // ZMQLS_QUEUE_H
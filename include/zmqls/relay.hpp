@@ -0,0 +1,84 @@
+#ifndef ZMQLS_RELAY_H
+#define ZMQLS_RELAY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <json/json.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/stream.hpp>
+
+namespace zmqls {
+        namespace relay {
+                using base_stream_t = ::zmqls::stream;
+
+                // Counters of one relay stream
+                struct stats_t {
+                        ::std::atomic<uint64_t> frames{0};
+                        ::std::atomic<uint64_t> bytes{0};
+                        ::std::atomic<uint64_t> keepalives{0};
+                        // Frames sent from the cache to new subscribers, 
+                        // and replays left out to keep them apart
+                        ::std::atomic<uint64_t> replayed{0};
+                        ::std::atomic<uint64_t> replays_limited{0};
+                        // Topics subscribed to upstream
+                        ::std::atomic<uint> subscriptions{0};
+                        // Prefixes with a frame in the cache
+                        ::std::atomic<uint> cached{0};
+                };
+
+                // Subscribes to "upstream" (a server, or another relay) for
+                // whatever its own subscribers on "address" want, once per 
+                // topic however many there are, and passes every message 
+                // on. Relays therefore chain into trees. The latest frame 
+                // of every prefix (with the keyframe it is relative to, if 
+                // tiled) is cached and sent on to anyone subscribing to 
+                // it, so they don't wait for the next one. XPUB cannot send
+                // to a single subscriber, so those already subscribed get 
+                // the repeats too (and drop them by their sequence numbers);
+                // replays of a topic are therefore at least 
+                // "replay_interval" seconds apart.
+                class stream : public base_stream_t {
+                public:
+                        using base_stream_t::base_stream_t;
+
+                        int start(::zmq::context_t &ctx);
+
+                        const stats_t &stats() const { return this->m_stats; }
+                        // Snapshot of the stats, as served by the metrics endpoint
+                        ::nlohmann::json metrics() const;
+                private:
+                        using parts_t = ::std::vector<::zmq::message_t>;
+
+                        struct cache_t {
+                                parts_t key;
+                                parts_t last;
+                        };
+
+                        stats_t m_stats;
+                        // Only touched by the stream's own thread
+                        ::std::map<string_t, cache_t> m_cache;
+                        ::std::set<string_t> m_topics;
+                        // When every topic was last replayed
+                        ::std::map<string_t, ::std::chrono::steady_clock::time_point> m_replays;
+                        double m_replay_interval = 1;
+
+                        // Passes a frame from upstream on, caching it
+                        void forward(::zmq::socket_t &down, parts_t &parts, bool cache);
+                        // Handles a (un)subscription from downstream
+                        void subscription(::zmq::socket_t &up, ::zmq::socket_t &down, 
+                                ::zmq::message_t &m, bool verbose);
+                        // Sends the cached frames `topic` matches
+                        void replay(::zmq::socket_t &down, const string_t &topic);
+                };
+        }
+}
+
+#endif // ZMQLS_RELAY_H
@@ -1,8 +1,18 @@
 #ifndef ZMQLS_SERVER_H
 #define ZMQLS_SERVER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <set>
+#include <utility>
 #include <string>
+#include <vector>
 
 #include <json/json.hpp>
 #include <opencv2/opencv.hpp>
@@ -10,101 +20,225 @@
 
 #include <zmqls/zmqls.hpp>
 #include <zmqls/stream.hpp>
+#include <zmqls/queue.hpp>
+#include <zmqls/header.hpp>
+#include <zmqls/source.hpp>
+#include <zmqls/hub.hpp>
+#include <zmqls/shm.hpp>
+#include <zmqls/histogram.hpp>
+#include <zmqls/change.hpp>
+#include <zmqls/tiles.hpp>
+#include <zmqls/codec.hpp>
 
 namespace zmqls {
         namespace server {
                 typedef ::zmqls::stream base_stream_t;
 
-                namespace device_settings {
-                        struct setting_t {
-                                int id;
-                                const char *name;
-                        };
-
-                        constexpr int zero_default[] = {
-                                cv::CAP_PROP_FRAME_WIDTH,
-                                cv::CAP_PROP_FRAME_HEIGHT,
-                                cv::CAP_PROP_FPS
-                        };
-
-                        constexpr setting_t lookup[] = {
-                                {cv::CAP_PROP_FRAME_WIDTH, "width"},
-                                {cv::CAP_PROP_FRAME_HEIGHT, "height"},
-                                {cv::CAP_PROP_FPS, "fps"},
-                                {cv::CAP_PROP_BRIGHTNESS, "brightness"},
-                                {cv::CAP_PROP_CONTRAST, "contrast"},
-                                {cv::CAP_PROP_SATURATION, "saturation"},
-                                {cv::CAP_PROP_HUE, "hue"},
-                                {cv::CAP_PROP_GAIN, "gain"},
-                                {cv::CAP_PROP_EXPOSURE, "exposure"}
-                        };
-
-                        const char *get_name(int id)
-                        {
-                                auto it = ::std::begin(zmqls::server::device_settings::lookup);
-                                auto end = ::std::end(zmqls::server::device_settings::lookup);
-                                for (; it != end && it->id != id; ++it)
-                                        ;
-
-                                return (it == end) ? nullptr : it->name;
-                        }
-
-                        typedef enum {
-                                OK = 0, USING_DEFAULT, NOT_FOUND, NOT_SUPPORTED, NOT_OPEN
-                        } update_result;
-                }
+                // One encoded version of the stream, published under the
+                // stream's prefix followed by its suffix
+                struct layer_t {
+                        ::std::string prefix;
+                        // What the layer is published under, see topic()
+                        ::std::string topic;
+                        // Size relative to the captured frame
+                        double scale = 1;
+                        ::std::unique_ptr<::zmqls::codec> codec;
+                        // Subscriptions to topics that match the prefix, 
+                        // the topics themselves are only kept by the 
+                        // publisher, counted per socket they came in on.
+                        // XPUB reports every subscription but only the last
+                        // unsubscription, so a count only ever drops to 0.
+                        ::std::atomic<uint> subscriptions{0};
+                        ::std::map<::std::pair<const void *, ::std::string>, uint> topics;
+                };
 
-                class stream : public base_stream_t {
-                private:
-                        using device_t =  ::cv::VideoCapture;
-                        using update_result_t = ::zmqls::server::device_settings::update_result;
+                using layers_t = ::std::vector<::std::unique_ptr<layer_t>>;
+
+                // A captured frame scaled to the size of every layer it
+                // is encoded for. Whichever encoder gets to it first 
+                // builds it, the other layers' encoders share the result.
+                struct pyramid_t {
+                        ::std::once_flag built;
+                        ::cv::Mat full;
+                        // Layers the frame is encoded for
+                        ::std::vector<bool> wanted;
+                        // One per layer, empty for the ones not wanted
+                        ::std::vector<::cv::Mat> levels;
+                };
+
+                // A frame travelling through the capture -> encode -> publish 
+                // pipeline, one per layer from the encode stage on
+                struct frame_t {
+                        // What goes on the wire, the sequence number is the
+                        // capture order (gaps mean dropped frames)
+                        ::zmqls::frame_header header;
+                        // Gapless position in its layer's encode order, used
+                        // for reordering
+                        ::std::uint64_t order = 0;
+                        uint layer = 0;
+                        ::std::shared_ptr<pyramid_t> pyramid;
+                        // Keyframe a tiled frame is relative to
+                        ::std::shared_ptr<pyramid_t> key;
+                        ::std::uint64_t key_seq = 0;
+                        // The image is a JPEG from the source, published as is
+                        bool compressed = false;
+                        ::cv::Mat image;
+                        ::zmqls::buffer_ptr_t data;
+                };
+
+                using frame_queue_t = ::zmqls::bounded_queue<frame_t>;
+
+                // What a stream stops doing while nobody is subscribed
+                enum class idle_t {
+                        // Keep encoding and sending regardless
+                        NONE,
+                        // Keep reading the source, but drop the frames
+                        ENCODE,
+                        // Stop reading the source as well
+                        CAPTURE
+                };
+
+                // State shared by the encoder workers of one stream
+                struct encoder_pool_t {
+                        ::std::mutex mutex;
+                        // Next place in every layer's encode order
+                        ::std::vector<::std::uint64_t> next;
+                        // Last frame whose age was recorded, once for all 
+                        // of its layers
+                        ::std::uint64_t aged = ~0ull;
+                        ::std::atomic<uint> running{0};
+                        // Encoded frames are written straight into these and
+                        // handed to ZMQ without another copy
+                        ::std::shared_ptr<::zmqls::buffer_pool> buffers;
+                        // Set when frames between keyframes are tiled
+                        const ::zmqls::tile_encoder *tiles = nullptr;
+                };
+
+                // Same-host subscribers get frames through a shared memory 
+                // ring, and only a notification of each through ZMQ
+                struct shm_link_t {
+                        ::zmqls::shm_ring ring;
+                        ::std::unique_ptr<::zmq::socket_t> notify;
+                };
+
+                // What the capture stage carries from one frame to the next
+                struct capture_state_t {
+                        frame_queue_t *out = nullptr;
+                        uint fps = 0;
+                        idle_t idle = idle_t::ENCODE;
+                        change_detector *gate = nullptr;
+                        uint keyframe = 0;
+                        bool passthrough = false;
+                        // Wait for the encoders instead of dropping frames
+                        bool wait = false;
+                        // Read the next frame only once the encoders have 
+                        // taken all of the last one, so it is the newest
+                        bool on_demand = false;
+                        ::std::uint64_t seq = 0;
+                        ::std::uint64_t stream_id = 0;
+                        // Last keyframe of every layer when tiling
+                        ::std::vector<::std::shared_ptr<pyramid_t>> keys;
+                        ::std::vector<::std::uint64_t> key_seqs;
+                        // Earliest a hub's next frame is taken, for the FPS limit
+                        ::std::chrono::steady_clock::time_point next;
+                };
 
-                        device_t device;
+                // Counters and timings (in microseconds) of one stream
+                struct stats_t {
+                        ::std::atomic<uint64_t> frames{0};
+                        ::std::atomic<uint64_t> bytes{0};
+                        // Frames dropped between stages
+                        ::std::atomic<uint64_t> dropped{0};
+                        // Frames the encoder failed on
+                        ::std::atomic<uint64_t> errors{0};
+                        // Frames not encoded since nothing changed
+                        ::std::atomic<uint64_t> skipped{0};
+                        // Keep-alive headers sent in their place
+                        ::std::atomic<uint64_t> keepalives{0};
+                        // Tiled frames and the tiles in them
+                        ::std::atomic<uint64_t> tiled{0};
+                        ::std::atomic<uint64_t> tiles{0};
+                        // Keyframes dropped before they were published, 
+                        // tiled frames relative to them are dropped too
+                        ::std::atomic<uint64_t> keys_lost{0};
+                        // Frames published as the source delivered them
+                        ::std::atomic<uint64_t> passthrough{0};
+                        // Frames written to shared memory, and those too 
+                        // big for it
+                        ::std::atomic<uint64_t> shm_frames{0};
+                        ::std::atomic<uint64_t> shm_skipped{0};
+                        // Subscribed topics that match any layer's prefix
+                        ::std::atomic<uint> subscriptions{0};
+                        ::zmqls::histogram capture;
+                        // How long frames waited between being grabbed (or
+                        // read, for sources that cannot tell) and an 
+                        // encoder taking them
+                        ::zmqls::histogram age;
+                        // Change detection, once per frame
+                        ::zmqls::histogram detect;
+                        // Downscaling for the layers, once per frame
+                        ::zmqls::histogram scale;
+                        ::zmqls::histogram encode;
+                        ::zmqls::histogram publish;
+                        // CPU time of each stage, added as its threads end
+                        ::std::atomic<int64_t> capture_cpu_us{0};
+                        ::std::atomic<int64_t> encode_cpu_us{0};
+                        ::std::atomic<int64_t> publish_cpu_us{0};
+                };
 
-                        void update_all_settings(::std::ostream &os, bool verbose);
+                class stream : public base_stream_t {
+                private:
+                        ::std::unique_ptr<source> m_source;
+                        layers_t m_layers;
+                        stats_t m_stats;
+
+                        // Wakes an idle capture stage on the first subscription
+                        ::std::mutex m_idle_mutex;
+                        ::std::condition_variable m_idle;
+                        // Someone new subscribed, send them a whole frame
+                        ::std::atomic<bool> m_refresh{false};
+                        // Set up by start() if the stream has "shm"
+                        ::std::unique_ptr<shm_link_t> m_shm;
+
+                        // Pipeline stages, each one runs on its own thread
+                        // (capture on one a capture_hub starts for the 
+                        // device, if the stream has one)
+                        void capture(capture_state_t &s);
+                        void encode(frame_queue_t &in, frame_queue_t &out, 
+                                encoder_pool_t &pool);
+                        void publish(::zmq::socket_t &pub, frame_queue_t &in, 
+                                uint window, idle_t idle, bool verbose);
+                        // Queues a job for the encoders as `s` says
+                        void hand_over(capture_state_t &s, frame_t &&f);
+                        // Hands a captured frame to the encoders
+                        void dispatch(capture_state_t &s, const ::cv::Mat &frame, 
+                                ::std::int64_t capture_us);
+                        // Retrieves and dispatches a frame a hub grabbed
+                        void hub_capture(capture_state_t &s, const capture_hub &hub, 
+                                ::cv::VideoCapture *device, ::std::int64_t grab_us);
+
+                        // Reads (un)subscriptions off the XPUB socket (and 
+                        // the shared memory notifications' one), waiting up
+                        // to `timeout` ms for the first one
+                        void subscriptions(::zmq::socket_t &pub, long timeout, bool verbose);
+                        // Writes a frame to shared memory and notifies
+                        void publish_shm(const frame_t &f);
+                        // Builds the layers from "layers", or a single one
+                        bool make_layers(const string_t &prefix);
+                        // The codec a layer asks for, or else the stream
+                        ::std::unique_ptr<codec> make_layer_codec(
+                                const ::nlohmann::json *layer);
+                        // Why the source's JPEG frames cannot be published 
+                        // as they are, nullptr if they can
+                        const char *passthrough_blocker() const;
                 public:
                         using base_stream_t::base_stream_t;
 
-                        bool open_device()
-                        {
-                                bool ret = false;
-                                auto odevice = this->m_json.get("device");
-                                if (odevice) {
-                                        if (odevice->is_number_unsigned())
-                                                ret = this->device.open(odevice->get<uint>());
-                                        else if (odevice->is_string())
-                                                ret = this->device.open(odevice->get<string_t>());
-                                }
-
-                                return ret;
-                        }
-
-                        update_result_t update_device(int id, bool (*check)(double))
-                        {
-                                if (!this->device.isOpened())
-                                        return update_result_t::NOT_OPEN;
-
-                                auto id_name = ::zmqls::server::device_settings::get_name(id);
-                                if (!id_name)
-                                        return update_result_t::NOT_FOUND;
-                                
-                                auto id_obj = this->m_json.get(id_name);
-                                if (!id_obj)
-                                        return update_result_t::NOT_FOUND;
-
-                                double val = id_obj->get<double>();
-                                if (!check(val))
-                                        return update_result_t::USING_DEFAULT;
-                                
-                                return this->device.set(id, val) ? update_result_t::OK : update_result_t::NOT_SUPPORTED;
-                        }
-
-                        update_result_t update_device(int id)
-                        {
-                                return this->update_device(id, [](double d){ return true; });
-                        }
-
                         int start(::zmq::context_t &ctx);
+
+                        const stats_t &stats() const { return this->m_stats; }
+                        // Snapshot of the stats, as served by the metrics endpoint
+                        ::nlohmann::json metrics() const;
                 };
         }
 }
@@ -0,0 +1,63 @@
+#ifndef ZMQLS_SHM_H
+#define ZMQLS_SHM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <zmqls/zmqls.hpp>
+
+namespace zmqls {
+        // A ring of encoded frames in POSIX shared memory, written by one 
+        // server and mapped read-only by any number of clients on the same
+        // host. Every frame is copied into it once, whatever the number of
+        // readers. Frames are addressed by their position in the ring, 
+        // which only ever grows; once the writer has gone around, older 
+        // positions are gone. Readers use frames in place and check 
+        // afterwards that they were not overwritten meanwhile.
+        class shm_ring {
+        public:
+                shm_ring() = default;
+                shm_ring(const shm_ring &) = delete;
+                shm_ring &operator=(const shm_ring &) = delete;
+                ~shm_ring() { this->close(); }
+
+                // Creates the ring `name` (such as "/zmqls-cam"), replacing
+                // any left over, with `slots` frames of up to `slot_size` bytes
+                bool create(const ::std::string &name, uint slots, 
+                        ::std::size_t slot_size);
+                // Maps the ring `name` created by someone else, read-only
+                bool open(const ::std::string &name);
+                // Unmaps the ring, and removes it if it was created here
+                void close();
+                bool is_open() const { return this->m_base != nullptr; }
+
+                // Tells rings apart that had the same name, such as when a
+                // server was restarted
+                uint64_t id() const;
+                ::std::size_t slot_size() const { return this->m_slot_size; }
+
+                // Copies a frame into the next slot, its position goes into
+                // `pos`. Returns false if it does not fit in a slot.
+                bool write(const uint8_t *d, ::std::size_t sz, uint64_t &pos);
+                // The frame at `pos`, or nullptr if it is gone
+                const uint8_t *read(uint64_t pos, ::std::size_t &sz) const;
+                // Whether the frame at `pos` is still there, to be checked 
+                // after whatever read() returned has been used
+                bool valid(uint64_t pos) const;
+        private:
+                ::std::string m_name;
+                bool m_owner = false;
+                uint8_t *m_base = nullptr;
+                ::std::size_t m_size = 0;
+                uint64_t m_slots = 0;
+                ::std::size_t m_slot_size = 0;
+                ::std::size_t m_stride = 0;
+                // Position of the next frame written
+                uint64_t m_next = 0;
+
+                uint8_t *slot(uint64_t pos) const;
+        };
+}
+
+#endif // ZMQLS_SHM_H
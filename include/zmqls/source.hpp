@@ -0,0 +1,226 @@
+#ifndef ZMQLS_SOURCE_H
+#define ZMQLS_SOURCE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+
+namespace zmqls {
+        namespace server {
+                namespace device_settings {
+                        struct setting_t {
+                                int id;
+                                const char *name;
+                        };
+
+                        constexpr int zero_default[] = {
+                                cv::CAP_PROP_FRAME_WIDTH,
+                                cv::CAP_PROP_FRAME_HEIGHT,
+                                cv::CAP_PROP_FPS,
+                                cv::CAP_PROP_BUFFERSIZE
+                        };
+
+                        constexpr setting_t lookup[] = {
+                                {cv::CAP_PROP_FRAME_WIDTH, "width"},
+                                {cv::CAP_PROP_FRAME_HEIGHT, "height"},
+                                {cv::CAP_PROP_FPS, "fps"},
+                                {cv::CAP_PROP_BRIGHTNESS, "brightness"},
+                                {cv::CAP_PROP_CONTRAST, "contrast"},
+                                {cv::CAP_PROP_SATURATION, "saturation"},
+                                {cv::CAP_PROP_HUE, "hue"},
+                                {cv::CAP_PROP_GAIN, "gain"},
+                                {cv::CAP_PROP_EXPOSURE, "exposure"},
+                                {cv::CAP_PROP_BUFFERSIZE, "buffer_size"}
+                        };
+
+                        inline const char *get_name(int id)
+                        {
+                                auto it = ::std::begin(zmqls::server::device_settings::lookup);
+                                auto end = ::std::end(zmqls::server::device_settings::lookup);
+                                for (; it != end && it->id != id; ++it)
+                                        ;
+
+                                return (it == end) ? nullptr : it->name;
+                        }
+
+                        typedef enum {
+                                OK = 0, USING_DEFAULT, NOT_FOUND, NOT_SUPPORTED, NOT_OPEN
+                        } update_result;
+                }
+
+
+                // Where a server stream gets its raw frames from
+                class source {
+                public:
+                        using json_t = ::zmqls::json::wrapper::basic;
+                        using string_t = ::std::string;
+
+                        virtual ~source() = default;
+
+                        // Prepares the source, reporting problems to `os`
+                        virtual bool open(::std::ostream &os, const string_t &name, 
+                                bool verbose) = 0;
+                        // Blocks until the next frame is ready, an empty 
+                        // frame means there was nothing to read this time
+                        virtual bool read(::cv::Mat &m) = 0;
+                        // Called before reading again after the source has
+                        // been left alone for a while
+                        virtual void resume() { }
+                        // Asks the source to hand out frames as the JPEG 
+                        // it got them in (a single row of bytes) instead of
+                        // decoding them. Returns false if it cannot.
+                        virtual bool passthrough() { return false; }
+                        // When the frame last read was grabbed (as given by
+                        // now_us()), 0 if the source cannot tell
+                        virtual ::std::int64_t timestamp() const { return 0; }
+                        // The capture device behind the source, for a
+                        // capture_hub to grab from instead of read()
+                        virtual ::cv::VideoCapture *video_capture() { return nullptr; }
+                };
+
+                // Builds the source described by a stream's JSON. Streams
+                // with a "source" object get a synthetic or file-backed 
+                // one, everything else reads from "device" as before.
+                ::std::unique_ptr<source> make_source(const source::json_t &j);
+
+                // Sources that produce frames themselves and so have to 
+                // keep their own pace (0 FPS means as fast as possible)
+                class paced_source : public source {
+                public:
+                        explicit paced_source(double fps): m_fps(fps) { }
+                protected:
+                        void pace();
+                private:
+                        double m_fps;
+                        ::std::chrono::steady_clock::time_point m_next;
+                };
+
+                // A cv::VideoCapture opened from the "device" index or URL, 
+                // with the capture settings given alongside it. With 
+                // "mjpeg" set the device is asked for MJPEG, which most 
+                // cameras deliver at higher resolutions and frame rates.
+                // With "latest" set a thread of its own keeps grabbing, so
+                // the driver's queue never fills up, and read() retrieves
+                // only the newest frame.
+                class device_source : public source {
+                public:
+                        using device_t = ::cv::VideoCapture;
+                        using update_result_t = device_settings::update_result;
+
+                        explicit device_source(const json_t &j): m_json(j) { }
+                        ~device_source();
+
+                        bool open(::std::ostream &os, const string_t &name, 
+                                bool verbose) override;
+                        bool read(::cv::Mat &m) override;
+                        void resume() override;
+                        // Only with "mjpeg" set, and once the device has
+                        // been opened
+                        bool passthrough() override;
+                        ::std::int64_t timestamp() const override { return this->m_timestamp; }
+                        // Not while grabbing in the background
+                        ::cv::VideoCapture *video_capture() override
+                        {
+                                return this->m_grabber.joinable() ? nullptr : &this->device;
+                        }
+
+                        update_result_t update_device(int id, bool (*check)(double));
+                        update_result_t update_device(int id)
+                        {
+                                return this->update_device(id, [](double d){ return true; });
+                        }
+                protected:
+                        json_t m_json;
+                        device_t device;
+                        // A fresh frame was grabbed by resume() already
+                        bool m_grabbed = false;
+
+                        // Grabbing in the background, the device is only 
+                        // touched with the mutex held from then on
+                        ::std::thread m_grabber;
+                        ::std::mutex m_mutex;
+                        ::std::condition_variable m_wake;
+                        bool m_running = false;
+                        // Lets read() in ahead of the next grab
+                        ::std::atomic<bool> m_reading{false};
+                        ::std::uint64_t m_grabs = 0;
+                        ::std::uint64_t m_read = 0;
+                        ::std::int64_t m_grab_us = 0;
+                        ::std::int64_t m_timestamp = 0;
+
+                        bool open_device();
+                        void grab();
+                        void update_all_settings(::std::ostream &os, 
+                                const string_t &name, bool verbose);
+                };
+
+                // Generated test pattern: colour bars with a box moving 
+                // "motion" pixels per frame and uniform noise of amplitude 
+                // "noise" on top. The noise is seeded, so every run 
+                // produces exactly the same frames.
+                class pattern_source : public paced_source {
+                public:
+                        explicit pattern_source(const json_t &j);
+
+                        bool open(::std::ostream &os, const string_t &name, 
+                                bool verbose) override;
+                        bool read(::cv::Mat &m) override;
+                private:
+                        ::cv::Size m_size;
+                        uint m_motion;
+                        uint m_noise;
+                        ::cv::Mat m_base;
+                        ::cv::Mat m_noise_frame;
+                        ::cv::RNG m_rng;
+                        uint64_t m_count = 0;
+                };
+
+                // A video file, or an image sequence given as a glob 
+                // pattern, played in a loop
+                class file_source : public paced_source {
+                public:
+                        explicit file_source(const json_t &j);
+
+                        bool open(::std::ostream &os, const string_t &name, 
+                                bool verbose) override;
+                        bool read(::cv::Mat &m) override;
+                private:
+                        string_t m_path;
+                        ::cv::VideoCapture m_video;
+                        ::std::vector<::cv::String> m_images;
+                        ::std::size_t m_next = 0;
+                };
+
+                // Preloads "frames" frames from another source ("from") 
+                // and replays them from memory, taking decoding and file 
+                // I/O out of the measurement. Frames are handed out 
+                // shared, the pipeline only ever reads them.
+                class memory_source : public paced_source {
+                public:
+                        explicit memory_source(const json_t &j);
+
+                        bool open(::std::ostream &os, const string_t &name, 
+                                bool verbose) override;
+                        bool read(::cv::Mat &m) override;
+                private:
+                        ::std::unique_ptr<source> m_from;
+                        uint m_count;
+                        ::std::vector<::cv::Mat> m_frames;
+                        ::std::size_t m_next = 0;
+                };
+        }
+}
+
+#endif // ZMQLS_SOURCE_H
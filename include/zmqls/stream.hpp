@@ -1,8 +1,12 @@
 #ifndef ZMQLS_STREAM_H
 #define ZMQLS_STREAM_H
 
+#include <atomic>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <json/json.hpp>
 #include <zmq.hpp>
@@ -18,8 +22,9 @@ namespace zmqls {
 
             json_t m_json;
             string_t m_name;
+            ::std::atomic<bool> m_running{true};
 
-            ::nlohmann::json from_file(const string_t &f)
+            static ::nlohmann::json from_file(const string_t &f)
             {
                   ::nlohmann::json j;
 
@@ -32,16 +37,69 @@ namespace zmqls {
       public:
             stream() = delete;
             stream(const json_t &j): m_json(j), m_name(
-                  m_json.get<string_t>("name", "unnamed stream", 
+                  m_json.get<string_t>("name", "unnamed stream",
                   &::zmqls::json::wrapper::is_string)
             ) { }
             stream(const ::nlohmann::json &j): stream(json_t(j)) { }
             stream(const string_t &f): stream(from_file(f)) { }
+            virtual ~stream() = default;
 
             const string_t &name() const { return this->m_name; }
 
+            // Asks a running stream to wind down, start() then returns
+            void stop() { this->m_running = false; }
+            bool running() const { return this->m_running; }
+
             virtual int start(zmq::context_t &ctx) = 0;
+
+            // Every stream configuration in a file, which holds either
+            // a single stream object or an array of them
+            static ::std::vector<::nlohmann::json> configs(const string_t &f)
+            {
+                  ::std::vector<::nlohmann::json> ret;
+
+                  auto j = from_file(f);
+                  if (j.is_array()) {
+                        for (const auto &s : j) {
+                              if (s.is_object())
+                                    ret.push_back(s);
+                        }
+                  } else if (j.is_object()) {
+                        ret.push_back(j);
+                  }
+
+                  return ret;
+            }
       };
+
+      // Runs every given stream concurrently, one thread each, on a
+      // shared context. Returns once all of them have stopped. Any extra
+      // arguments are passed on to each stream's constructor.
+      template <typename T, typename... Args> int run_streams(zmq::context_t &ctx,
+            const ::std::vector<::nlohmann::json> &configs, Args &... args)
+      {
+            ::std::vector<::std::unique_ptr<T>> streams;
+            for (const auto &c : configs)
+                  streams.emplace_back(new T(c, args...));
+
+            // No need for an extra thread with a single stream
+            if (streams.size() == 1)
+                  return streams.front()->start(ctx);
+
+            ::std::atomic<int> ret{EXIT_SUCCESS};
+            ::std::vector<::std::thread> threads;
+            for (auto &s : streams) {
+                  threads.emplace_back([&ctx, &ret, &s]{
+                        if (s->start(ctx) != EXIT_SUCCESS)
+                              ret = EXIT_FAILURE;
+                  });
+            }
+
+            for (auto &t : threads)
+                  t.join();
+
+            return ret;
+      }
 }
 
 #endif // ZMQLS_STREAM_H
\ No newline at end of file
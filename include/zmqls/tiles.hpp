@@ -0,0 +1,66 @@
+#ifndef ZMQLS_TILES_H
+#define ZMQLS_TILES_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/header.hpp>
+#include <zmqls/codec.hpp>
+
+namespace zmqls {
+        // Server side of tiled frames: splits a frame into a grid of 
+        // `size` pixel tiles and encodes only those whose mean absolute 
+        // difference per channel from the keyframe is above `threshold`,
+        // each with the codec of the frame.
+        // Holds no per-frame state, so encoder workers can share one.
+        class tile_encoder {
+        public:
+                tile_encoder(uint size, double threshold):
+                        m_size(size ? size : 64), m_threshold(threshold) { }
+
+                // Fills `out` with the payload of a tiled frame, returns
+                // the number of tiles in it
+                ::std::size_t encode(const ::cv::Mat &frame, const ::cv::Mat &key, 
+                        uint64_t key_seq, codec &c, buffer_t &out) const;
+        private:
+                uint m_size;
+                double m_threshold;
+        };
+
+        // Client side of tiled frames: the last keyframe and a canvas 
+        // holding it with the tiles of the latest tiled frame on top
+        class canvas {
+        public:
+                // A keyframe replaces everything
+                void key(const ::cv::Mat &frame, uint64_t seq);
+                // Decodes the tiles into the canvas, returns false if they
+                // belong to a keyframe other than the current one or do 
+                // not fit it
+                bool composite(const tile_table &t, const uint8_t *d, codec &c);
+
+                const ::cv::Mat &image() const { return this->m_canvas; }
+                bool has_key(uint64_t seq) const 
+                {
+                        return this->m_valid && this->m_key_seq == seq;
+                }
+        private:
+                ::cv::Mat m_key;
+                ::cv::Mat m_canvas;
+                uint64_t m_key_seq = 0;
+                bool m_valid = false;
+                // The canvas still is the keyframe itself, and has to be 
+                // copied before any tile goes on top
+                bool m_shared = true;
+                // Tiles of the last tiled frame, by row * cols + col
+                ::std::vector<bool> m_dirty;
+                int m_cols = 0;
+                ::cv::Size m_tile;
+
+                ::cv::Rect tile_rect(int col, int row) const;
+        };
+}
+
+#endif // ZMQLS_TILES_H
@@ -0,0 +1,63 @@
+#ifndef ZMQLS_TRANSFORM_H
+#define ZMQLS_TRANSFORM_H
+
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+
+namespace zmqls {
+        // The client-side transform chain (resize, flip, rotate, gamma), 
+        // compiled once from a stream's JSON. The geometric steps are 
+        // composed into a single affine matrix and applied in one pass, 
+        // gamma is then applied in place on that pass's output. Lookup 
+        // tables and the matrix are kept between frames and only rebuilt 
+        // when the input size changes.
+        class transform {
+        public:
+                using json_t = ::zmqls::json::wrapper::basic;
+
+                transform() = default;
+                explicit transform(const json_t &j);
+
+                // Runs the chain on `in`, writing the result to `out`, which
+                // never shares memory with the chain's own buffers. When 
+                // nothing has to change (an empty chain, or a lone resize to
+                // the size `in` already has) `out` is `in` itself, uncopied,
+                // so clone it before writing to `in` while `out` is in use.
+                void apply(const ::cv::Mat &in, ::cv::Mat &out);
+
+                // The cv::imdecode flags for a frame of the given source 
+                // size. When the chain shrinks the frame to 1/2, 1/4 or 1/8 
+                // of it or less, JPEG can be decoded at that reduced scale 
+                // in the DCT domain and only the rest is left to resize.
+                int decode_flags(const ::cv::Size &src) const;
+
+                bool empty() const { return this->m_geometry == NONE && this->m_lut.empty(); }
+        private:
+                // How the geometric steps are carried out, a lone resize or
+                // flip is cheaper through its dedicated OpenCV routine
+                typedef enum {
+                        NONE, RESIZE, FLIP, WARP
+                } geometry;
+
+                // Settings
+                ::cv::Size m_size;
+                int m_flip = 0;
+                bool m_flip_on = false;
+                int m_angle = 0;
+                ::cv::Mat m_lut;
+                geometry m_geometry = NONE;
+
+                // Cached per input size
+                ::cv::Size m_in_size;
+                ::cv::Mat m_affine;
+                ::cv::Size m_out_size;
+
+                void rebuild(const ::cv::Size &in);
+        };
+}
+
+#endif // ZMQLS_TRANSFORM_H
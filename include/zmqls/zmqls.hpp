@@ -1,6 +1,10 @@
 #ifndef ZMQLS_H
 #define ZMQLS_H
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -10,6 +14,27 @@
 typedef unsigned int uint;
 
 namespace zmqls {
+        using buffer_t = std::vector<uint8_t>;
+        using buffer_ptr_t = std::shared_ptr<buffer_t>;
+
+        // Pool of reusable byte buffers. A buffer goes back to the pool 
+        // (keeping its capacity) once its last owner, which may be a ZMQ 
+        // message still queued in an I/O thread, lets go of it.
+        class buffer_pool : public std::enable_shared_from_this<buffer_pool> {
+        public:
+                static std::shared_ptr<buffer_pool> create(std::size_t max_free = 8);
+
+                buffer_ptr_t acquire();
+                std::size_t free_count() const;
+        private:
+                explicit buffer_pool(std::size_t max_free): m_max_free(max_free) { }
+                void release(buffer_t *b);
+
+                const std::size_t m_max_free;
+                std::vector<std::unique_ptr<buffer_t>> m_free;
+                mutable std::mutex m_mutex;
+        };
+
         std::size_t data_to_msg(
                 zmq::message_t &m, 
                 const char *p, const size_t &p_sz, 
@@ -20,9 +45,38 @@ namespace zmqls {
                 const std::string &p, 
                 const std::vector<uint8_t> &d
         );
+        // Zero-copy: the message shares ownership of the buffer
+        std::size_t data_to_msg(zmq::message_t &m, const buffer_ptr_t &d);
+        // Receives every part of the next multipart message
+        std::size_t recv_parts(zmq::socket_t &s, std::vector<zmq::message_t> &parts);
+        // Sends the parts as one multipart message, which leaves them empty
+        bool send_parts(zmq::socket_t &s, std::vector<zmq::message_t> &parts);
+        // CPU time consumed so far by the calling thread
+        int64_t thread_cpu_us();
+
+        // Keeps adding the CPU time of the thread it was made on to a 
+        // total, so totals are current while threads still run and can
+        // be sampled at any time
+        class cpu_meter {
+        public:
+                explicit cpu_meter(std::atomic<int64_t> &total):
+                        m_total(total), m_last(thread_cpu_us()) { }
+                ~cpu_meter() { this->update(); }
+
+                // Adds what was used since the last update
+                void update()
+                {
+                        int64_t now = thread_cpu_us();
+                        this->m_total += now - this->m_last;
+                        this->m_last = now;
+                }
+        private:
+                std::atomic<int64_t> &m_total;
+                int64_t m_last;
+        };
         void image_to_data(std::vector<uint8_t> &v, const cv::Mat &m);
         uint8_t *get_beg(const zmq::message_t &m, const size_t &p_sz);
         uint8_t *get_beg(const zmq::message_t &m, const std::string &p);
 }
 
-#endif // ZMQLS_H
\ No newline at end of file
+#endif // ZMQLS_H
@@ -0,0 +1,36 @@
+#include <zmqls/change.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/opencv.hpp>
+
+bool zmqls::change_detector::changed(const cv::Mat &frame)
+{
+        // Area averaging also smooths away most of the sensor noise
+        int w = std::min((int) this->m_width, frame.cols);
+        int h = std::max((int) std::lround((double) frame.rows * w / frame.cols), 1);
+        cv::resize(frame, this->m_thumb, cv::Size(w, h), 0, 0, cv::INTER_AREA);
+
+        bool ret = this->m_reset 
+                || this->m_thumb.size() != this->m_reference.size()
+                || this->m_thumb.type() != this->m_reference.type()
+                || (this->m_max_skip && this->m_skipped >= this->m_max_skip);
+
+        this->m_difference = 0;
+        if (!ret) {
+                this->m_difference = cv::norm(this->m_thumb, this->m_reference, cv::NORM_L1) 
+                        / (this->m_thumb.total() * this->m_thumb.channels());
+                ret = this->m_difference > this->m_threshold;
+        }
+
+        if (ret) {
+                std::swap(this->m_reference, this->m_thumb);
+                this->m_skipped = 0;
+                this->m_reset = false;
+        } else {
+                ++this->m_skipped;
+        }
+
+        return ret;
+}
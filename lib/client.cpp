@@ -0,0 +1,567 @@
+#include <zmqls/client.hpp>
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+
+#include <zmq.hpp>
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+#include <zmqls/header.hpp>
+#include <zmqls/transform.hpp>
+#include <zmqls/histogram.hpp>
+#include <zmqls/metrics.hpp>
+#include <zmqls/tiles.hpp>
+#include <zmqls/codec.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+zmqls::client::image_queue_t &zmqls::client::display::attach(base_stream_t &s,
+        histogram *shown_us)
+{
+        lock_guard<mutex> lock(this->m_mutex);
+        this->m_entries.push_back({&s, make_unique<image_queue_t>(1), shown_us, false});
+
+        return *this->m_entries.back().slot;
+}
+
+void zmqls::client::display::detach(base_stream_t &s)
+{
+        lock_guard<mutex> lock(this->m_mutex);
+        this->m_entries.remove_if([&s](const entry_t &e) {
+                return e.stream == &s;
+        });
+}
+
+bool zmqls::client::display::run()
+{
+        // Escape key constant
+        int ESC = 27;
+
+        while (!this->m_closed) {
+                {
+                        lock_guard<mutex> lock(this->m_mutex);
+                        for (auto &e : this->m_entries) {
+                                // Render whatever is newest, if anything
+                                cv::Mat frame;
+                                if (!e.slot->pop_for(frame, milliseconds(0)))
+                                        continue;
+
+                                // Create the display window on first use
+                                if (!e.shown) {
+                                        cv::namedWindow(e.stream->name(), 
+                                                cv::WINDOW_AUTOSIZE);
+                                        e.shown = true;
+                                }
+                                auto show_start = steady_clock::now();
+                                cv::imshow(e.stream->name(), frame);
+                                if (e.shown_us) {
+                                        e.shown_us->record(duration_cast<microseconds>(
+                                                steady_clock::now() - show_start).count());
+                                }
+                        }
+                }
+
+                // Show the frames for a total of 1 millisecond
+                // Stop everything if escape key is pressed
+                if (cv::waitKey(1) == ESC) {
+                        lock_guard<mutex> lock(this->m_mutex);
+                        for (auto &e : this->m_entries)
+                                e.stream->stop();
+
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+// Maps the ring a notification points to, again if the server has 
+// created it anew since
+static bool map_ring(zmqls::shm_ring &ring, const string &name, const zmqls::shm_ref &r)
+{
+        if (ring.is_open() && ring.id() == r.ring)
+                return true;
+
+        return ring.open(name) && ring.id() == r.ring;
+}
+
+void zmqls::client::stream::receive(zmq::socket_t &sub, const string_t &topic, 
+        const string_t &shm, message_queue_t &out, bool decode)
+{
+        // Only used for keyframes, the decoder maps the ring on its own
+        shm_ring ring;
+
+        vector<zmq::message_t> parts;
+        bool first = true;
+        uint64_t last_seq = 0, stream_id = 0;
+        cpu_meter cpu(this->m_stats.receive_cpu_us);
+        while (this->running()) {
+                cpu.update();
+
+                // Messages are [topic][header][data], skip anything else
+                frame_header h;
+                if (zmqls::recv_parts(sub, parts) != 3 
+                        || parts[0].size() != topic.size()
+                        || memcmp(parts[0].data(), topic.data(), topic.size()) != 0
+                        || !zmqls::parse_header(parts[1], h))
+                        continue;
+
+                // The server started over, seq goes back to 0 every time
+                if (!first && h.stream_id != stream_id) {
+                        ++this->m_stats.resets;
+                        first = true;
+                        lock_guard<mutex> lock(this->m_key_mutex);
+                        this->m_key.rebuild();
+                        this->m_key_seq = 0;
+                }
+
+                // ZMQ keeps messages in order, so anything not newer was 
+                // seen before (relays repeat frames for new subscribers).
+                // Count frames lost on the way.
+                if (!first && h.seq <= last_seq)
+                        continue;
+                if (!first)
+                        this->m_stats.lost += h.seq - last_seq - 1;
+                first = false;
+                last_seq = h.seq;
+                stream_id = h.stream_id;
+
+                // Nothing changed on the server, whatever is shown stays
+                if (h.flags & FLAG_KEEPALIVE) {
+                        ++this->m_stats.keepalives;
+                        continue;
+                }
+
+                // A frame in shared memory stays there, the message only 
+                // says where it is
+                const uint8_t *d = nullptr;
+                size_t sz = parts[2].size();
+                shm_ref ref;
+                if (!shm.empty() && (!parse_shm_ref(parts[2], ref) 
+                        || !map_ring(ring, shm, ref) || !(d = ring.read(ref.pos, sz)))) {
+                        ++this->m_stats.overrun;
+                        continue;
+                }
+
+                // Tiled frames need this until the next one (ZMQ shares 
+                // the data instead of copying it, shared memory does not
+                // keep it that long)
+                if (decode && (h.flags & FLAG_KEYFRAME)) {
+                        lock_guard<mutex> lock(this->m_key_mutex);
+                        if (shm.empty()) {
+                                this->m_key.copy(&parts[2]);
+                        } else {
+                                this->m_key.rebuild(d, sz);
+                                // Overwritten while it was copied
+                                if (!ring.valid(ref.pos))
+                                        this->m_key.rebuild();
+                        }
+                        this->m_key_seq = h.seq;
+                }
+
+                ++this->m_stats.frames;
+                this->m_stats.bytes += sz;
+                this->m_stats.receive.record(now_us() - h.encode_us);
+
+                // Without decoding, a frame is done as soon as it is here
+                if (!decode) {
+                        this->m_stats.latency.record(now_us() - h.capture_us);
+                        continue;
+                }
+
+                // Keep draining the socket, an older frame still waiting 
+                // to be decoded is replaced by this one
+                if (!out.push(move(parts)))
+                        ++this->m_stats.stale_received;
+        }
+
+        out.close();
+}
+
+void zmqls::client::stream::print_stats(ostream &os, double fps, double bps)
+{
+        // Timings are in microseconds, print them in milliseconds
+        auto ms = [](uint64_t us) { return us / 1000.0; };
+        const auto &st = this->m_stats;
+
+        os << this->m_name << ": " 
+                << fps << " fps, " << bps / (1024 * 1024) << " MiB/s, "
+                << st.frames << " frames, " << st.lost << " lost, " 
+                << st.errors << " errors";
+        if (st.decode.count()) {
+                os << ", decode mean/p99 " 
+                        << st.decode.mean() / 1000.0 << "/" 
+                        << ms(st.decode.percentile(0.99)) << " ms";
+        }
+        os << ", latency p50/p99/p999 " 
+                << ms(st.latency.percentile(0.5)) << "/" 
+                << ms(st.latency.percentile(0.99)) << "/" 
+                << ms(st.latency.percentile(0.999)) << " ms" << endl;
+}
+
+nlohmann::json zmqls::client::stream::metrics() const
+{
+        const auto &st = this->m_stats;
+
+        // Cost of every codec that has been used
+        auto codecs = nlohmann::json::array();
+        for (const auto &c : this->m_decoders) {
+                if (!c)
+                        continue;
+
+                auto j = c->metrics();
+                if (j["decode_us"]["count"].get<uint64_t>())
+                        codecs.push_back(j);
+        }
+
+        return {
+                {"name", this->m_name},
+                {"role", "client"},
+                {"time_us", now_us()},
+                {"frames", st.frames.load()},
+                {"bytes", st.bytes.load()},
+                {"lost", st.lost.load()},
+                {"resets", st.resets.load()},
+                {"stale_received", st.stale_received.load()},
+                {"stale_decoded", st.stale_decoded.load()},
+                {"errors", st.errors.load()},
+                {"keepalives", st.keepalives.load()},
+                {"unanchored", st.unanchored.load()},
+                {"overrun", st.overrun.load()},
+                {"codecs", codecs},
+                {"stages_us", {
+                        {"receive", histogram_to_json(st.receive)},
+                        {"decode", histogram_to_json(st.decode)},
+                        {"transform", histogram_to_json(st.transform)},
+                        {"display", histogram_to_json(st.display)},
+                        {"latency", histogram_to_json(st.latency)}
+                }}
+        };
+}
+
+int zmqls::client::stream::start(zmq::context_t &ctx)
+{
+        // To prevent over-searching of JSON data
+        auto address = this->m_json.get<string_t>(
+                "address", "", &zmqls::json::wrapper::is_string);
+        auto prefix = this->m_json.get<string_t>(
+                "prefix", "", &zmqls::json::wrapper::is_string);
+        auto fps = this->m_json.get<uint>(
+                "fps", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto verbose = this->m_json.get<bool>(
+                "verbose", false, &zmqls::json::wrapper::is_boolean);
+        auto custom_width = this->m_json.get<uint>(
+                "width", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto custom_height = this->m_json.get<uint>(
+                "height", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto gamma = this->m_json.get<double>(
+                "gamma", -1, &zmqls::json::wrapper::is_number);
+        auto angle = this->m_json.get<int>(
+                "angle", 0, &zmqls::json::wrapper::is_number_integer);
+        auto flip = this->m_json.get<string_t>(
+                "flip", "", &zmqls::json::wrapper::is_string);
+        auto decode = this->m_json.get<bool>(
+                "decode", true, &zmqls::json::wrapper::is_boolean);
+        auto report = this->m_json.get<double>(
+                "report", 1, &zmqls::json::wrapper::is_number);
+        auto run_time = this->m_json.get<double>(
+                "duration", 0, &zmqls::json::wrapper::is_number);
+        auto headless = this->m_json.get<string_t>(
+                "sink", "display", &zmqls::json::wrapper::is_string) == "headless";
+
+        // On the server's host, frames can be read from its shared memory,
+        // with notifications of them from "address" in "shm" instead
+        string_t shm;
+        auto oshm = this->m_json.get("shm");
+        if (oshm && oshm->is_object()) {
+                json_t shj(*oshm);
+                shm = shj.get<string_t>("name", "", &zmqls::json::wrapper::is_string);
+                address = shj.get<string_t>("address", "", &zmqls::json::wrapper::is_string);
+                if (shm.empty()) {
+                        cerr << this->m_name << ": No shared memory name specified" << endl;
+                        return EXIT_FAILURE;
+                }
+        }
+
+        // Sanity check
+        if (address.empty()) {
+                cerr << this->m_name << ": No address specified" << endl;
+                return EXIT_FAILURE;
+        }
+        if (prefix.empty()) {
+                cerr << this->m_name << ": No prefix specified" << endl;
+                return EXIT_FAILURE;
+        }
+
+        // Create subscriber socket and attempt to connect to given address
+        // Also set the prefix
+        zmq::socket_t sub(ctx, ZMQ_SUB);
+        try {
+                sub.connect(address.c_str());
+        } catch (const zmq::error_t &e) {
+                cerr << this->m_name 
+                        << ": Failed to connect to given address" << endl;
+                cerr << this->m_name << ": " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+        // Only this prefix, not the other layers of the stream
+        auto topic = zmqls::topic(prefix);
+        sub.setsockopt(ZMQ_SUBSCRIBE, topic.data(), topic.size());
+
+        // Wake up periodically so a stopped stream notices
+        int timeout = 100;
+        sub.setsockopt(ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // A decoder for every codec this build knows, indexed by codec id,
+        // with the stream's settings (JPEG's "backend" and "fast_dct")
+        this->m_decoders.clear();
+        for (uint i = 0; i <= (uint) codec_id::RAW_ZSTD; ++i)
+                this->m_decoders.push_back(make_codec((codec_id) i, this->m_json));
+
+        // Export stats for monitoring if asked to
+        metrics_endpoint exporter([this]{ return this->metrics(); });
+        if (!exporter.start(ctx, this->m_json, this->m_name, cerr))
+                return EXIT_FAILURE;
+        
+        // If verbose, print settings
+        if (verbose) {
+                cout << this->m_name << ": Address: " << address << endl;
+                cout << this->m_name << ": Prefix: " << prefix << endl;
+                cout << this->m_name 
+                        << ": Shared memory: " << (!shm.empty() ? shm : "N/A") << endl;
+                cout << this->m_name 
+                        << ": FPS limit: " << (fps ? to_string(fps) : "N/A") << endl;
+                cout << this->m_name 
+                        << ": Custom width: " 
+                        << (custom_width ? to_string(custom_width) : "N/A") << endl;
+                cout << this->m_name 
+                        << ": Custom height: " 
+                        << (custom_height ? to_string(custom_height) : "N/A") << endl;
+                cout << this->m_name 
+                        << ": Gamma adjustment: " 
+                        << (gamma >= 0 ? to_string(gamma) : "N/A") << endl;
+                cout << this->m_name
+                        << ": Rotation angle: "
+                        << (angle ? to_string(angle) : "N/A") << endl;
+                cout << this->m_name
+                        << ": Flip string: "
+                        << (!flip.empty() ? flip : "N/A") << endl;
+                cout << this->m_name
+                        << ": Sink: " << (headless ? "headless" : "display") 
+                        << (decode ? "" : " (no decoding)") << endl;
+        }
+
+        // Build the transform chain once, it caches whatever it can
+        zmqls::transform chain(this->m_json);
+
+        // Receive on a thread of its own so the socket never backs up,
+        // decode and transform here, and leave showing to the display 
+        // unless running headless
+        message_queue_t received(1);
+        thread receive_thread(&stream::receive, this, 
+                ref(sub), cref(topic), cref(shm), ref(received), decode || !headless);
+        image_queue_t *shown = headless ? nullptr 
+                : &this->m_display.attach(*this, &this->m_stats.display);
+
+        // For FPS limiter
+        auto last_frame = steady_clock::now();
+
+        // For periodic reports and the run time limit
+        auto started = steady_clock::now();
+        auto last_report = started;
+        uint64_t last_frames = 0;
+        uint64_t last_bytes = 0;
+
+        // Parts of the last received message
+        vector<zmq::message_t> parts;
+
+        // The last keyframe with the latest tiles on top, of the server's
+        // run frames last came from
+        zmqls::canvas canvas;
+        uint64_t stream_id = 0;
+
+        // Frames are decoded in place when in shared memory
+        shm_ring ring;
+
+        // Decoders are shared with the metrics endpoint
+        auto &decoders = this->m_decoders;
+
+        // Main loop, runs until the stream is stopped
+        cpu_meter cpu(this->m_stats.decode_cpu_us);
+        while (true) {
+                cpu.update();
+                auto now = steady_clock::now();
+
+                // Headless runs may be limited in time
+                if (run_time > 0 && now - started >= duration<double>(run_time))
+                        this->stop();
+
+                // Report throughput and timings every so often when headless
+                if (headless && report > 0 
+                        && now - last_report >= duration<double>(report)) {
+                        double secs = duration<double>(now - last_report).count();
+                        this->print_stats(cout, 
+                                (this->m_stats.frames - last_frames) / secs, 
+                                (this->m_stats.bytes - last_bytes) / secs);
+                        last_report = now;
+                        last_frames = this->m_stats.frames;
+                        last_bytes = this->m_stats.bytes;
+                }
+
+                if (!received.pop_for(parts, milliseconds(100))) {
+                        if (received.closed())
+                                break;
+                        continue;
+                }
+
+                // For FPS limiter
+                time_point<steady_clock> wait_until;
+                if (fps > 0)
+                        wait_until = last_frame + milliseconds(1000 / fps);
+
+                // Decode data straight out of the message, or out of 
+                // shared memory if that is where it is
+                frame_header h;
+                zmqls::parse_header(parts[1], h);
+                auto d = (const uint8_t *) parts[2].data();
+                size_t sz = parts[2].size();
+                shm_ref ref;
+                if (!shm.empty() && (!parse_shm_ref(parts[2], ref) 
+                        || !map_ring(ring, shm, ref) || !(d = ring.read(ref.pos, sz)))) {
+                        ++this->m_stats.overrun;
+                        continue;
+                }
+                cv::Size size(h.width, h.height);
+
+                // Keyframes of an earlier run have seqs the frames of this
+                // one may refer to as well
+                if (h.stream_id != stream_id)
+                        canvas = zmqls::canvas();
+                stream_id = h.stream_id;
+
+                // The header says which codec the frame was encoded with
+                auto id = (size_t) h.codec;
+                codec *c = id < decoders.size() ? decoders[id].get() : nullptr;
+                if (!c) {
+                        ++this->m_stats.errors;
+                        continue;
+                }
+
+                auto decode_start = steady_clock::now();
+                cv::Mat frame;
+                if (h.flags & FLAG_TILED) {
+                        // Tiles go on top of their keyframe, which is only
+                        // decoded here if it was replaced by newer frames 
+                        // before it got its turn
+                        tile_table t;
+                        if (!parse_tile_table(d, sz, t)) {
+                                ++this->m_stats.errors;
+                                continue;
+                        }
+                        if (!canvas.has_key(t.key_seq)) {
+                                zmq::message_t key;
+                                {
+                                        lock_guard<mutex> lock(this->m_key_mutex);
+                                        if (this->m_key_seq == t.key_seq)
+                                                key.copy(&this->m_key);
+                                }
+                                cv::Mat k;
+                                if (key.size() && c->decode((const uint8_t *) key.data(), 
+                                        key.size(), size, cv::IMREAD_COLOR, k))
+                                        canvas.key(k, t.key_seq);
+                        }
+                        if (!canvas.composite(t, d, *c)) {
+                                ++this->m_stats.unanchored;
+                                continue;
+                        }
+                        frame = canvas.image();
+                } else {
+                        // Keyframes are kept as they are, tiles have to fit
+                        c->decode(d, sz, size, (h.flags & FLAG_KEYFRAME) 
+                                ? cv::IMREAD_COLOR : chain.decode_flags(size), frame);
+                        if ((h.flags & FLAG_KEYFRAME) && !frame.empty())
+                                canvas.key(frame, h.seq);
+                }
+                this->m_stats.decode.record(duration_cast<microseconds>(
+                        steady_clock::now() - decode_start).count());
+
+                // The server may have written over the frame while it was
+                // being decoded, then whatever came out is not to be trusted
+                // (tiles may have spoiled the canvas, it starts over)
+                if (!shm.empty() && !ring.valid(ref.pos)) {
+                        ++this->m_stats.overrun;
+                        if (h.flags & (FLAG_TILED | FLAG_KEYFRAME))
+                                canvas = zmqls::canvas();
+                        continue;
+                }
+
+                // Skip erroneous data
+                if (frame.size().width == 0) {
+                        ++this->m_stats.errors;
+                        continue;
+                }
+
+                // Run the precompiled transform chain, into a fresh frame 
+                // since the display may still be showing the previous one
+                auto transform_start = steady_clock::now();
+                cv::Mat out;
+                chain.apply(frame, out);
+                frame = out;
+
+                // Without any transform that is the canvas itself, which 
+                // the next tiles are drawn on while it may be on display
+                if (shown && frame.data == canvas.image().data && (h.flags & FLAG_TILED))
+                        frame = frame.clone();
+                this->m_stats.transform.record(duration_cast<microseconds>(
+                        steady_clock::now() - transform_start).count());
+
+                // Skip erroneous data after transformations, a frame the 
+                // display has not gotten to yet is replaced by this one
+                this->m_stats.latency.record(now_us() - h.capture_us);
+                if (shown && frame.size().width > 0 && frame.size().height > 0
+                        && !shown->push(move(frame)))
+                        ++this->m_stats.stale_decoded;
+
+                // For FPS limiter
+                if (fps > 0)
+                        this_thread::sleep_until(wait_until);
+                auto next_frame = steady_clock::now();
+
+                // Print stats if verbose (latency is capture to decoded)
+                if (verbose) {
+                        double fps = 1 / duration<double>(
+                                next_frame - last_frame).count();
+                        cout << this->m_name << ": FPS: " << fps 
+                                << ", latency: " << (now_us() - h.capture_us) / 1000.0
+                                << " ms, lost: " << this->m_stats.lost
+                                << ", stale: " << this->m_stats.stale_received 
+                                << " received, " << this->m_stats.stale_decoded
+                                << " decoded" << endl;
+                }
+
+                last_frame = next_frame;
+        }
+
+        cpu.update();
+        receive_thread.join();
+        if (shown)
+                this->m_display.detach(*this);
+
+        // Final summary over the whole run
+        if (headless && report > 0) {
+                double secs = duration<double>(steady_clock::now() - started).count();
+                this->print_stats(cout, this->m_stats.frames / secs, 
+                        this->m_stats.bytes / secs);
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,561 @@
+#include <zmqls/codec.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#ifdef ZMQLS_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef ZMQLS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef ZMQLS_HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/metrics.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+bool zmqls::codec::encode(const cv::Mat &in, buffer_t &out)
+{
+        auto start = steady_clock::now();
+        bool ret = this->do_encode(in, out);
+        this->m_encode.record(duration_cast<microseconds>(
+                steady_clock::now() - start).count());
+
+        if (ret) {
+                this->m_raw_bytes += in.total() * in.elemSize();
+                this->m_encoded_bytes += out.size();
+        }
+
+        return ret;
+}
+
+bool zmqls::codec::decode(const uint8_t *d, size_t sz, const cv::Size &size,
+        int flags, cv::Mat &out)
+{
+        if (size.width <= 0 || size.height <= 0 
+                || size.width > MAX_SIDE || size.height > MAX_SIDE)
+                return false;
+
+        auto start = steady_clock::now();
+        bool ret = this->do_decode(d, sz, size, flags, out) && !out.empty();
+        this->m_decode.record(duration_cast<microseconds>(
+                steady_clock::now() - start).count());
+
+        if (ret) {
+                this->m_raw_bytes += out.total() * out.elemSize();
+                this->m_encoded_bytes += sz;
+        }
+
+        return ret;
+}
+
+nlohmann::json zmqls::codec::metrics() const
+{
+        uint64_t encoded = this->m_encoded_bytes;
+
+        return {
+                {"codec", this->name()},
+                {"quality", this->quality()},
+                {"ratio", encoded ? (double) this->m_raw_bytes / encoded : 0},
+                {"encode_us", histogram_to_json(this->m_encode)},
+                {"decode_us", histogram_to_json(this->m_decode)}
+        };
+}
+
+// Anything cv::imencode and cv::imdecode know by file extension
+class image_codec : public zmqls::codec {
+public:
+        image_codec(zmqls::codec_id id, const char *name, const char *ext,
+                int param, uint quality):
+                m_id(id), m_name(name), m_ext(ext),
+                m_params{param, (int) quality}, m_quality(quality) { }
+
+        zmqls::codec_id id() const override { return this->m_id; }
+        const char *name() const override { return this->m_name; }
+        uint quality() const override { return this->m_quality; }
+protected:
+        bool do_encode(const cv::Mat &in, zmqls::buffer_t &out) const override
+        {
+                return cv::imencode(this->m_ext, in, out, this->m_params);
+        }
+
+        bool do_decode(const uint8_t *d, size_t sz, const cv::Size &, int flags,
+                cv::Mat &out) const override
+        {
+                out = cv::imdecode(cv::Mat(1, (int) sz, CV_8UC1, (void *) d), flags);
+                return !out.empty();
+        }
+private:
+        zmqls::codec_id m_id;
+        const char *m_name;
+        const char *m_ext;
+        vector<int> m_params;
+        uint m_quality;
+};
+
+#ifdef ZMQLS_HAVE_TURBOJPEG
+// JPEG straight through libjpeg-turbo, skipping OpenCV's codec layer,
+// which sets up a new (de)compressor for every frame. Every thread keeps 
+// its own handles, and frames are decoded into the output Mat directly 
+// (at a reduced scale if asked to).
+class turbo_jpeg_codec : public zmqls::codec {
+public:
+        turbo_jpeg_codec(uint quality, int subsampling, bool fast_dct):
+                m_quality(quality), m_subsampling(subsampling), 
+                m_flags(fast_dct ? TJFLAG_FASTDCT : 0) { }
+
+        zmqls::codec_id id() const override { return zmqls::codec_id::JPEG; }
+        const char *name() const override { return "jpeg"; }
+        uint quality() const override { return this->m_quality; }
+protected:
+        using handle_t = unique_ptr<void, int (*)(tjhandle)>;
+
+        bool do_encode(const cv::Mat &in, zmqls::buffer_t &out) const override
+        {
+                thread_local handle_t handle(tjInitCompress(), &tjDestroy);
+                // Owned by TurboJPEG, which grows it as needed
+                thread_local struct buffer {
+                        unsigned char *data = nullptr;
+                        unsigned long size = 0;
+                        ~buffer() { tjFree(this->data); }
+                } buf;
+
+                int format, subsampling = this->m_subsampling;
+                switch (in.type()) {
+                case CV_8UC1:
+                        format = TJPF_GRAY;
+                        subsampling = TJSAMP_GRAY;
+                        break;
+                case CV_8UC3:
+                        format = TJPF_BGR;
+                        break;
+                case CV_8UC4:
+                        format = TJPF_BGRA;
+                        break;
+                default:
+                        return false;
+                }
+
+                if (!handle || tjCompress2(handle.get(), in.data, in.cols, (int) in.step, 
+                        in.rows, format, &buf.data, &buf.size, subsampling, 
+                        (int) this->m_quality, this->m_flags) != 0)
+                        return false;
+
+                // Only the compressed bytes are copied. Compressing into
+                // the pooled buffer itself would mean first growing it to 
+                // the worst case size, and std::vector zero-fills that;
+                // buffer_t can't take a default-init allocator since 
+                // cv::imencode() only writes to a plain std::vector.
+                out.assign(buf.data, buf.data + buf.size);
+
+                return true;
+        }
+
+        bool do_decode(const uint8_t *d, size_t sz, const cv::Size &, int flags,
+                cv::Mat &out) const override
+        {
+                thread_local handle_t handle(tjInitDecompress(), &tjDestroy);
+
+                int w, h, subsampling, colorspace;
+                if (!handle || tjDecompressHeader3(handle.get(), d, sz, 
+                        &w, &h, &subsampling, &colorspace) != 0)
+                        return false;
+
+                // Same meaning as the cv::imdecode flags
+                int denom = 1;
+                if (flags > 0 && (flags & cv::IMREAD_REDUCED_GRAYSCALE_8) == cv::IMREAD_REDUCED_GRAYSCALE_8)
+                        denom = 8;
+                else if (flags > 0 && (flags & cv::IMREAD_REDUCED_GRAYSCALE_4) == cv::IMREAD_REDUCED_GRAYSCALE_4)
+                        denom = 4;
+                else if (flags > 0 && (flags & cv::IMREAD_REDUCED_GRAYSCALE_2) == cv::IMREAD_REDUCED_GRAYSCALE_2)
+                        denom = 2;
+                bool gray = flags == cv::IMREAD_GRAYSCALE || (denom > 1 && !(flags & cv::IMREAD_COLOR));
+
+                tjscalingfactor scale = {1, denom};
+                out.create(TJSCALED(h, scale), TJSCALED(w, scale), gray ? CV_8UC1 : CV_8UC3);
+
+                return tjDecompress2(handle.get(), d, sz, out.data, out.cols, 
+                        (int) out.step, out.rows, gray ? TJPF_GRAY : TJPF_BGR, 
+                        this->m_flags) == 0;
+        }
+private:
+        uint m_quality;
+        int m_subsampling;
+        int m_flags;
+};
+#endif
+
+// Raw frames carry no channel count, it follows from the size
+static int raw_channels(size_t sz, const cv::Size &size)
+{
+        size_t px = (size_t) size.area();
+        if (!px || sz % px || sz / px < 1 || sz / px > 4)
+                return 0;
+
+        return (int) (sz / px);
+}
+
+class raw_codec : public zmqls::codec {
+public:
+        zmqls::codec_id id() const override { return zmqls::codec_id::RAW; }
+        const char *name() const override { return "raw"; }
+protected:
+        bool do_encode(const cv::Mat &in, zmqls::buffer_t &out) const override
+        {
+                zmqls::image_to_data(out, in);
+                return true;
+        }
+
+        bool do_decode(const uint8_t *d, size_t sz, const cv::Size &size, int,
+                cv::Mat &out) const override
+        {
+                int channels = raw_channels(sz, size);
+                if (!channels)
+                        return false;
+
+                out.create(size, CV_8UC(channels));
+                memcpy(out.data, d, sz);
+
+                return true;
+        }
+};
+
+// Raw frames compressed by a general purpose compressor, which pays off
+// on fast links where the CPU time of JPEG matters more than bandwidth
+class compressed_raw_codec : public zmqls::codec {
+protected:
+        // Compresses `n` bytes into `out` after whatever it already holds
+        virtual bool compress(const uint8_t *d, size_t n, zmqls::buffer_t &out) const = 0;
+        // Size of the raw frame, 0 if unknown
+        virtual size_t raw_size(const uint8_t *d, size_t sz) const = 0;
+        virtual bool decompress(const uint8_t *d, size_t sz, uint8_t *out,
+                size_t n) const = 0;
+        // How many times its size a payload can expand to at most
+        virtual size_t max_ratio() const = 0;
+
+        bool do_encode(const cv::Mat &in, zmqls::buffer_t &out) const override
+        {
+                // Only a continuous frame can be compressed in place
+                const cv::Mat *src = &in;
+                thread_local cv::Mat copy;
+                if (!in.isContinuous()) {
+                        in.copyTo(copy);
+                        src = &copy;
+                }
+
+                out.clear();
+                return this->compress(src->data, src->total() * src->elemSize(), out);
+        }
+
+        bool do_decode(const uint8_t *d, size_t sz, const cv::Size &size, int,
+                cv::Mat &out) const override
+        {
+                // Allocated before decompressing, so it has to be what the
+                // header says and something the payload could expand to
+                size_t n = this->raw_size(d, sz);
+                if (n > this->max_ratio() * sz)
+                        return false;
+                int channels = raw_channels(n, size);
+                if (!channels)
+                        return false;
+
+                out.create(size, CV_8UC(channels));
+                return this->decompress(d, sz, out.data, n);
+        }
+};
+
+#ifdef ZMQLS_HAVE_LZ4
+// LZ4 blocks do not record their size, so it goes in front (4 bytes, LE)
+class lz4_codec : public compressed_raw_codec {
+public:
+        explicit lz4_codec(uint acceleration): m_acceleration(acceleration ? acceleration : 1) { }
+
+        zmqls::codec_id id() const override { return zmqls::codec_id::RAW_LZ4; }
+        const char *name() const override { return "raw+lz4"; }
+        uint quality() const override { return this->m_acceleration; }
+protected:
+        bool compress(const uint8_t *d, size_t n, zmqls::buffer_t &out) const override
+        {
+                if (n > (size_t) LZ4_MAX_INPUT_SIZE)
+                        return false;
+
+                out.resize(4 + LZ4_compressBound((int) n));
+                for (int i = 0; i < 4; ++i)
+                        out[i] = (uint8_t) (n >> (8 * i));
+
+                int sz = LZ4_compress_fast((const char *) d, (char *) out.data() + 4,
+                        (int) n, (int) out.size() - 4, (int) this->m_acceleration);
+                out.resize(sz > 0 ? 4 + sz : 0);
+
+                return sz > 0;
+        }
+
+        size_t raw_size(const uint8_t *d, size_t sz) const override
+        {
+                if (sz < 4)
+                        return 0;
+
+                size_t n = 0;
+                for (int i = 0; i < 4; ++i)
+                        n |= (size_t) d[i] << (8 * i);
+
+                return n;
+        }
+
+        // A byte of an LZ4 block never stands for more than 255
+        size_t max_ratio() const override { return 255; }
+
+        bool decompress(const uint8_t *d, size_t sz, uint8_t *out, size_t n) const override
+        {
+                return LZ4_decompress_safe((const char *) d + 4, (char *) out,
+                        (int) sz - 4, (int) n) == (int) n;
+        }
+private:
+        uint m_acceleration;
+};
+#endif
+
+#ifdef ZMQLS_HAVE_ZSTD
+class zstd_codec : public compressed_raw_codec {
+public:
+        explicit zstd_codec(uint level): m_level(level) { }
+
+        zmqls::codec_id id() const override { return zmqls::codec_id::RAW_ZSTD; }
+        const char *name() const override { return "raw+zstd"; }
+        uint quality() const override { return this->m_level; }
+protected:
+        bool compress(const uint8_t *d, size_t n, zmqls::buffer_t &out) const override
+        {
+                // A context per thread saves setting one up for every frame
+                thread_local unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> ctx(
+                        ZSTD_createCCtx(), &ZSTD_freeCCtx);
+
+                out.resize(ZSTD_compressBound(n));
+                size_t sz = ZSTD_compressCCtx(ctx.get(), out.data(), out.size(),
+                        d, n, (int) this->m_level);
+                if (ZSTD_isError(sz)) {
+                        out.clear();
+                        return false;
+                }
+                out.resize(sz);
+
+                return true;
+        }
+
+        size_t raw_size(const uint8_t *d, size_t sz) const override
+        {
+                auto n = ZSTD_getFrameContentSize(d, sz);
+                if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR)
+                        return 0;
+
+                return (size_t) n;
+        }
+
+        // An RLE block spends 4 bytes on up to 128 KiB
+        size_t max_ratio() const override { return 32 << 10; }
+
+        bool decompress(const uint8_t *d, size_t sz, uint8_t *out, size_t n) const override
+        {
+                thread_local unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> ctx(
+                        ZSTD_createDCtx(), &ZSTD_freeDCtx);
+
+                return ZSTD_decompressDCtx(ctx.get(), out, n, d, sz) == n;
+        }
+private:
+        uint m_level;
+};
+#endif
+
+// The frame (SOF) segment of a JPEG image after its marker and length,
+// nullptr if there is none before the image data
+static const uint8_t *jpeg_frame(const uint8_t *d, size_t sz, size_t &len)
+{
+        if (sz < 4 || d[0] != 0xff || d[1] != 0xd8)
+                return nullptr;
+
+        // Walk the marker segments up to the first start of frame
+        size_t i = 2;
+        while (i + 4 <= sz) {
+                if (d[i] != 0xff)
+                        return nullptr;
+                uint8_t marker = d[i + 1];
+                if (marker == 0xff) {
+                        ++i;
+                        continue;
+                }
+
+                len = (size_t) d[i + 2] << 8 | d[i + 3];
+                // SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+                if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4
+                        && marker != 0xc8 && marker != 0xcc) {
+                        if (len < 8 || i + 2 + len > sz)
+                                return nullptr;
+                        len -= 2;
+                        return d + i + 4;
+                }
+                // Start of scan, no frame marker before the image data
+                if (marker == 0xda || len < 2)
+                        return nullptr;
+
+                i += 2 + len;
+        }
+
+        return nullptr;
+}
+
+cv::Size zmqls::jpeg_size(const uint8_t *d, size_t sz)
+{
+        // Precision, height, width
+        size_t len;
+        auto f = jpeg_frame(d, sz, len);
+        if (!f)
+                return cv::Size();
+
+        return cv::Size(f[3] << 8 | f[4], f[1] << 8 | f[2]);
+}
+
+string zmqls::jpeg_subsampling(const uint8_t *d, size_t sz)
+{
+        // Precision, height, width, components and 3 bytes per component,
+        // the second of which holds its horizontal and vertical sampling
+        // factors. Only the usual images with 1x1 chroma are named.
+        size_t len;
+        auto f = jpeg_frame(d, sz, len);
+        if (!f || len < 6u + 3u * f[5])
+                return "";
+        if (f[5] == 1)
+                return "gray";
+        if (f[5] != 3 || f[10] != 0x11 || f[13] != 0x11)
+                return "";
+
+        static const struct {
+                uint8_t factors;
+                const char *name;
+        } samplings[] = {
+                {0x11, "444"}, {0x21, "422"}, {0x22, "420"}, {0x12, "440"}, {0x41, "411"}
+        };
+        for (const auto &s : samplings) {
+                if (f[7] == s.factors)
+                        return s.name;
+        }
+
+        return "";
+}
+
+nlohmann::json zmqls::codec_settings(const codec::json_t &stream, 
+        const nlohmann::json *layer)
+{
+        static const char *keys[] = {
+                "codec", "encode", "backend", "subsampling", "fast_dct"
+        };
+
+        nlohmann::json ret = nlohmann::json::object();
+        for (const char *key : keys) {
+                if (auto v = stream.get(key))
+                        ret[key] = *v;
+                if (layer && layer->find(key) != layer->end())
+                        ret[key] = layer->at(key);
+        }
+
+        return ret;
+}
+
+unique_ptr<zmqls::codec> zmqls::make_codec(const string &name, const codec::json_t &j)
+{
+        auto quality = [&j](uint def) {
+                return j.get<uint>("encode", def, &zmqls::json::wrapper::is_number_unsigned);
+        };
+
+        if (name == "jpeg") {
+#ifdef ZMQLS_HAVE_TURBOJPEG
+                auto backend = j.get<string>(
+                        "backend", "turbo", &zmqls::json::wrapper::is_string);
+                auto subsampling = j.get<string>(
+                        "subsampling", "420", &zmqls::json::wrapper::is_string);
+                auto fast_dct = j.get<bool>(
+                        "fast_dct", false, &zmqls::json::wrapper::is_boolean);
+
+                static const struct {
+                        const char *name;
+                        int value;
+                } samplings[] = {
+                        {"444", TJSAMP_444}, {"422", TJSAMP_422}, {"420", TJSAMP_420},
+                        {"440", TJSAMP_440}, {"411", TJSAMP_411}, {"gray", TJSAMP_GRAY}
+                };
+                if (backend == "turbo") {
+                        for (const auto &s : samplings) {
+                                if (subsampling == s.name)
+                                        return make_unique<turbo_jpeg_codec>(
+                                                quality(80), s.value, fast_dct);
+                        }
+
+                        return nullptr;
+                }
+#endif
+                return make_unique<image_codec>(codec_id::JPEG, "jpeg", ".jpg",
+                        cv::IMWRITE_JPEG_QUALITY, quality(80));
+        }
+        if (name == "png")
+                return make_unique<image_codec>(codec_id::PNG, "png", ".png",
+                        cv::IMWRITE_PNG_COMPRESSION, quality(1));
+        if (name == "webp")
+                return make_unique<image_codec>(codec_id::WEBP, "webp", ".webp",
+                        cv::IMWRITE_WEBP_QUALITY, quality(80));
+        if (name == "raw")
+                return make_unique<raw_codec>();
+#ifdef ZMQLS_HAVE_LZ4
+        if (name == "raw+lz4")
+                return make_unique<lz4_codec>(quality(1));
+#endif
+#ifdef ZMQLS_HAVE_ZSTD
+        if (name == "raw+zstd")
+                return make_unique<zstd_codec>(quality(1));
+#endif
+
+        return nullptr;
+}
+
+unique_ptr<zmqls::codec> zmqls::make_codec(codec_id id, const codec::json_t &j)
+{
+        static const struct {
+                codec_id id;
+                const char *name;
+        } names[] = {
+                {codec_id::JPEG, "jpeg"},
+                {codec_id::RAW, "raw"},
+                {codec_id::PNG, "png"},
+                {codec_id::WEBP, "webp"},
+                {codec_id::RAW_LZ4, "raw+lz4"},
+                {codec_id::RAW_ZSTD, "raw+zstd"}
+        };
+
+        for (const auto &n : names) {
+                if (n.id == id)
+                        return make_codec(n.name, j);
+        }
+
+        return nullptr;
+}
+
+vector<string> zmqls::codec_names()
+{
+        vector<string> ret = {"jpeg", "raw", "png", "webp"};
+#ifdef ZMQLS_HAVE_LZ4
+        ret.push_back("raw+lz4");
+#endif
+#ifdef ZMQLS_HAVE_ZSTD
+        ret.push_back("raw+zstd");
+#endif
+
+        return ret;
+}
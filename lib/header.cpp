@@ -0,0 +1,184 @@
+#include <zmqls/header.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include <zmq.hpp>
+
+// Fixed-width little-endian (de)serialisation, independent of host order
+template <typename T> static uint8_t *put(uint8_t *p, T v)
+{
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+                *p++ = (uint8_t) ((uint64_t) v >> (8 * i));
+
+        return p;
+}
+
+template <typename T> static const uint8_t *take(const uint8_t *p, T &v)
+{
+        uint64_t r = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+                r |= (uint64_t) *p++ << (8 * i);
+        v = (T) r;
+
+        return p;
+}
+
+int64_t zmqls::now_us()
+{
+        using namespace std::chrono;
+        return duration_cast<microseconds>(
+                system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t zmqls::new_stream_id()
+{
+        // Random, so runs on different hosts or after a reboot differ too
+        std::random_device rd;
+        uint64_t id = 0;
+        while (!id)
+                id = (uint64_t) rd() << 32 | rd();
+
+        return id;
+}
+
+std::size_t zmqls::header_to_msg(zmq::message_t &m, const frame_header &h)
+{
+        zmq::message_t msg(frame_header::SIZE);
+
+        uint8_t *p = (uint8_t *) msg.data();
+        p = put(p, h.version);
+        p = put(p, (uint8_t) h.codec);
+        p = put(p, h.flags);
+        p = put(p, (uint8_t) 0);
+        p = put(p, h.quality);
+        p = put(p, h.width);
+        p = put(p, h.height);
+        p = put(p, h.seq);
+        p = put(p, h.capture_us);
+        p = put(p, h.encode_us);
+        p = put(p, h.stream_id);
+
+        m.move(&msg);
+
+        return frame_header::SIZE;
+}
+
+bool zmqls::parse_header(const uint8_t *d, const std::size_t &d_sz, frame_header &h)
+{
+        // Later versions may only ever append fields
+        if (d_sz < frame_header::SIZE || d[0] < 1)
+                return false;
+
+        uint8_t codec, reserved;
+        const uint8_t *p = d;
+        p = take(p, h.version);
+        p = take(p, codec);
+        p = take(p, h.flags);
+        p = take(p, reserved);
+        p = take(p, h.quality);
+        p = take(p, h.width);
+        p = take(p, h.height);
+        p = take(p, h.seq);
+        p = take(p, h.capture_us);
+        p = take(p, h.encode_us);
+        p = take(p, h.stream_id);
+        h.codec = (codec_id) codec;
+
+        return true;
+}
+
+bool zmqls::parse_header(const zmq::message_t &m, frame_header &h)
+{
+        return zmqls::parse_header(
+                (const uint8_t *) m.data(), m.size(), h);
+}
+
+std::size_t zmqls::shm_ref_to_msg(zmq::message_t &m, const shm_ref &r)
+{
+        zmq::message_t msg(shm_ref::SIZE);
+
+        uint8_t *p = (uint8_t *) msg.data();
+        p = put(p, r.ring);
+        p = put(p, r.pos);
+
+        m.move(&msg);
+
+        return shm_ref::SIZE;
+}
+
+bool zmqls::parse_shm_ref(const zmq::message_t &m, shm_ref &r)
+{
+        if (m.size() != shm_ref::SIZE)
+                return false;
+
+        const uint8_t *p = (const uint8_t *) m.data();
+        p = take(p, r.ring);
+        p = take(p, r.pos);
+
+        return true;
+}
+
+void zmqls::write_tile_table(uint8_t *d, const tile_table &t)
+{
+        uint8_t *p = d;
+        p = put(p, t.key_seq);
+        p = put(p, t.tile_width);
+        p = put(p, t.tile_height);
+        p = put(p, (uint32_t) t.tiles.size());
+        for (const auto &tile : t.tiles) {
+                p = put(p, tile.col);
+                p = put(p, tile.row);
+                p = put(p, tile.size);
+        }
+}
+
+bool zmqls::parse_tile_table(const uint8_t *d, const std::size_t &d_sz, tile_table &t)
+{
+        if (d_sz < tile_table::size(0))
+                return false;
+
+        uint32_t count;
+        const uint8_t *p = d;
+        p = take(p, t.key_seq);
+        p = take(p, t.tile_width);
+        p = take(p, t.tile_height);
+        p = take(p, count);
+        if (!t.tile_width || !t.tile_height || d_sz < tile_table::size(count))
+                return false;
+
+        t.tiles.resize(count);
+        std::size_t offset = tile_table::size(count);
+        for (auto &tile : t.tiles) {
+                p = take(p, tile.col);
+                p = take(p, tile.row);
+                p = take(p, tile.size);
+                tile.offset = offset;
+                offset += tile.size;
+        }
+
+        return offset <= d_sz;
+}
+
+std::string zmqls::topic(const std::string &prefix)
+{
+        return prefix + '\0';
+}
+
+bool zmqls::send_frame(zmq::socket_t &s, const std::string &p, 
+        const frame_header &h, const buffer_ptr_t &d)
+{
+        // The prefix goes first on its own so subscriptions still match it
+        zmq::message_t prefix(p.data(), p.length());
+        zmq::message_t header;
+        zmqls::header_to_msg(header, h);
+        zmq::message_t data;
+        if (d)
+                zmqls::data_to_msg(data, d);
+
+        return s.send(prefix, ZMQ_SNDMORE) 
+                && s.send(header, ZMQ_SNDMORE) 
+                && s.send(data);
+}
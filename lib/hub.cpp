@@ -0,0 +1,223 @@
+#include <zmqls/hub.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/header.hpp>
+
+std::shared_ptr<zmqls::server::capture_hub> zmqls::server::capture_hub::get(
+        const std::string &name)
+{
+        static std::mutex mutex;
+        static std::map<std::string, std::weak_ptr<capture_hub>> hubs;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto ret = hubs[name].lock();
+        if (!ret) {
+                ret = std::make_shared<capture_hub>();
+                hubs[name] = ret;
+        }
+
+        return ret;
+}
+
+zmqls::server::capture_hub::capture_hub()
+{
+        this->m_thread = std::thread(&capture_hub::run, this);
+}
+
+zmqls::server::capture_hub::~capture_hub()
+{
+        this->m_running = false;
+        if (this->m_thread.joinable())
+                this->m_thread.join();
+}
+
+uint64_t zmqls::server::capture_hub::add(const cv::VideoCapture &device, 
+        const callback_t &callback)
+{
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        auto e = std::make_unique<entry_t>();
+        e->id = this->m_next_id++;
+        e->device = device;
+        e->callback = callback;
+        e->thread = std::thread(&capture_hub::serve, this, std::ref(*e));
+
+        uint64_t id = e->id;
+        this->m_added.push_back(std::move(e));
+        this->m_changed.notify_all();
+
+        return id;
+}
+
+void zmqls::server::capture_hub::remove(uint64_t id)
+{
+        // Done once the hub's thread has dropped it, between two rounds
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        this->m_removed.insert(id);
+        this->m_changed.wait(lock, [this, id]{ 
+                return !this->m_removed.count(id) || !this->m_running;
+        });
+}
+
+void zmqls::server::capture_hub::run()
+{
+        using namespace std::chrono;
+
+        // Nanoseconds, so streams notice a stop in time, and so a device 
+        // that was being retrieved from is soon waited on again
+        constexpr int64_t timeout = 100000000;
+        constexpr int64_t busy_timeout = 2000000;
+
+        std::vector<cv::VideoCapture> devices;
+        std::vector<size_t> waiting;
+        std::vector<int> ready;
+        while (this->m_running) {
+                // Take on the changes since the last round
+                std::set<uint64_t> ids;
+                std::vector<entry_ptr_t> removed;
+                {
+                        std::lock_guard<std::mutex> lock(this->m_mutex);
+                        for (auto &e : this->m_added)
+                                this->m_entries.push_back(std::move(e));
+                        this->m_added.clear();
+
+                        ids = this->m_removed;
+                        auto gone = std::stable_partition(this->m_entries.begin(), 
+                                this->m_entries.end(), [&ids](const entry_ptr_t &e) { 
+                                        return !ids.count(e->id); 
+                                });
+                        std::move(gone, this->m_entries.end(), std::back_inserter(removed));
+                        this->m_entries.erase(gone, this->m_entries.end());
+                }
+
+                // Outside the lock, which their threads take when done
+                if (!ids.empty()) {
+                        for (auto &e : removed)
+                                this->stop(*e);
+
+                        std::lock_guard<std::mutex> lock(this->m_mutex);
+                        for (auto id : ids)
+                                this->m_removed.erase(id);
+                        this->m_changed.notify_all();
+                }
+
+                // Copies share the device, they are only handles. Devices
+                // still being retrieved from sit this round out.
+                devices.clear();
+                waiting.clear();
+                for (size_t i = 0; i < this->m_entries.size(); ++i) {
+                        if (this->m_entries[i]->busy)
+                                continue;
+                        devices.push_back(this->m_entries[i]->device);
+                        waiting.push_back(i);
+                }
+
+                // Nothing to wait on, until something is added or done
+                if (devices.empty()) {
+                        std::unique_lock<std::mutex> lock(this->m_mutex);
+                        this->m_changed.wait_for(lock, milliseconds(100), [this]{
+                                return !this->m_running || !this->m_added.empty() 
+                                        || !this->m_removed.empty()
+                                        || std::any_of(this->m_entries.begin(), 
+                                                this->m_entries.end(), [](const entry_ptr_t &e) {
+                                                        return !e->busy;
+                                                });
+                        });
+                        continue;
+                }
+
+                ready.clear();
+                if (!this->m_failed) {
+                        try {
+                                cv::VideoCapture::waitAny(devices, ready, 
+                                        devices.size() < this->m_entries.size() 
+                                                ? busy_timeout : timeout);
+                        } catch (const cv::Exception &) {
+                                this->m_failed = true;
+                        }
+                }
+                int64_t grab_us = now_us();
+
+                // Retrieved on the devices' own threads, while the others
+                // are waited on again
+                for (int r : ready) {
+                        auto &e = *this->m_entries[waiting[r]];
+                        e.busy = true;
+                        {
+                                std::lock_guard<std::mutex> lock(e.mutex);
+                                e.grab_us = grab_us;
+                        }
+                        e.wake.notify_one();
+                }
+
+                // Only there to tell everyone
+                if (this->m_failed)
+                        std::this_thread::sleep_for(milliseconds(100));
+        }
+
+        // Nobody waits on a hub that is gone
+        std::vector<entry_ptr_t> added;
+        {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                added.swap(this->m_added);
+        }
+        for (auto &e : this->m_entries)
+                this->stop(*e);
+        for (auto &e : added)
+                this->stop(*e);
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_changed.notify_all();
+}
+
+void zmqls::server::capture_hub::serve(entry_t &e)
+{
+        using namespace std::chrono;
+
+        std::unique_lock<std::mutex> lock(e.mutex);
+        while (true) {
+                e.wake.wait_for(lock, milliseconds(100), [&e]{
+                        return e.stopping || e.grab_us != 0;
+                });
+                if (e.stopping)
+                        break;
+
+                int64_t grab_us = e.grab_us;
+                e.grab_us = 0;
+                lock.unlock();
+                e.callback(grab_us ? &e.device : nullptr, grab_us);
+
+                // Back into the hub's waits
+                if (grab_us) {
+                        {
+                                std::lock_guard<std::mutex> hub_lock(this->m_mutex);
+                                e.busy = false;
+                        }
+                        this->m_changed.notify_all();
+                }
+                lock.lock();
+        }
+}
+
+void zmqls::server::capture_hub::stop(entry_t &e)
+{
+        {
+                std::lock_guard<std::mutex> lock(e.mutex);
+                e.stopping = true;
+        }
+        e.wake.notify_one();
+
+        if (e.thread.joinable())
+                e.thread.join();
+}
@@ -0,0 +1,135 @@
+#include <zmqls/metrics.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+nlohmann::json zmqls::histogram_to_json(const histogram &h)
+{
+        return {
+                {"count", h.count()},
+                {"mean", h.mean()},
+                {"p50", h.percentile(0.5)},
+                {"p90", h.percentile(0.9)},
+                {"p99", h.percentile(0.99)},
+                {"p999", h.percentile(0.999)},
+                {"max", h.max()}
+        };
+}
+
+bool zmqls::metrics_endpoint::start(zmq::context_t &ctx,
+        const zmqls::json::wrapper::basic &config, const string &name, ostream &err)
+{
+        auto j = config.get("metrics");
+        if (!j || !j->is_object())
+                return true;
+
+        zmqls::json::wrapper::basic metrics(*j);
+        auto address = metrics.get<string>(
+                "address", "", &zmqls::json::wrapper::is_string);
+        auto type = metrics.get<string>(
+                "type", "pub", &zmqls::json::wrapper::is_string);
+        auto interval = metrics.get<double>(
+                "interval", 1, &zmqls::json::wrapper::is_number);
+        auto topic = metrics.get<string>(
+                "topic", name, &zmqls::json::wrapper::is_string);
+
+        // Sanity check
+        if (address.empty()) {
+                err << name << ": No metrics address specified" << endl;
+                return false;
+        }
+        if (type != "pub" && type != "rep") {
+                err << name << ": Unknown metrics socket type: " << type << endl;
+                return false;
+        }
+        if (interval <= 0)
+                interval = 1;
+
+        this->m_socket.reset(new zmq::socket_t(ctx, type == "pub" ? ZMQ_PUB : ZMQ_REP));
+        try {
+                this->m_socket->bind(address.c_str());
+        } catch (const zmq::error_t &e) {
+                err << name << ": Failed to bind metrics to given address: "
+                        << address << endl;
+                err << name << ": " << e.what() << endl;
+                this->m_socket.reset();
+                return false;
+        }
+
+        // The socket belongs to the metrics thread from here on
+        this->m_running = true;
+        if (type == "pub")
+                this->m_thread = thread(&metrics_endpoint::publish, this, topic, interval);
+        else
+                this->m_thread = thread(&metrics_endpoint::reply, this);
+
+        return true;
+}
+
+void zmqls::metrics_endpoint::stop()
+{
+        {
+                lock_guard<mutex> lock(this->m_mutex);
+                this->m_running = false;
+        }
+        this->m_wake.notify_all();
+
+        if (this->m_thread.joinable())
+                this->m_thread.join();
+        this->m_socket.reset();
+}
+
+void zmqls::metrics_endpoint::publish(const string &topic, double interval)
+{
+        unique_lock<mutex> lock(this->m_mutex);
+        while (this->m_running) {
+                lock.unlock();
+
+                auto body = this->m_snapshot().dump();
+                zmq::message_t t(topic.data(), topic.size());
+                zmq::message_t m(body.data(), body.size());
+                this->m_socket->send(t, ZMQ_SNDMORE);
+                this->m_socket->send(m);
+
+                lock.lock();
+                this->m_wake.wait_for(lock, duration<double>(interval),
+                        [this]{ return !this->m_running; });
+        }
+}
+
+void zmqls::metrics_endpoint::reply()
+{
+        // Wake up periodically so a stop is noticed
+        int timeout = 100;
+        this->m_socket->setsockopt(ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+
+        vector<zmq::message_t> request;
+        while (true) {
+                {
+                        lock_guard<mutex> lock(this->m_mutex);
+                        if (!this->m_running)
+                                break;
+                }
+
+                // Whatever was asked, the answer is the current snapshot
+                if (zmqls::recv_parts(*this->m_socket, request) == 0)
+                        continue;
+
+                auto body = this->m_snapshot().dump();
+                zmq::message_t m(body.data(), body.size());
+                this->m_socket->send(m);
+        }
+}
@@ -0,0 +1,232 @@
+#include <zmqls/relay.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+#include <zmqls/header.hpp>
+#include <zmqls/metrics.hpp>
+
+using namespace std;
+
+// Copies that share the data, ZMQ only counts references
+static void copy_parts(vector<zmq::message_t> &to, vector<zmq::message_t> &from)
+{
+        to.resize(from.size());
+        for (size_t i = 0; i < from.size(); ++i)
+                to[i].copy(&from[i]);
+}
+
+void zmqls::relay::stream::forward(zmq::socket_t &down, parts_t &parts, bool cache)
+{
+        frame_header h;
+        bool frame = parts.size() == 3 && zmqls::parse_header(parts[1], h);
+        if (frame && (h.flags & FLAG_KEEPALIVE)) {
+                ++this->m_stats.keepalives;
+        } else if (frame) {
+                ++this->m_stats.frames;
+                this->m_stats.bytes += parts[2].size();
+        }
+
+        // A keyframe starts over, tiles only make sense on top of it and
+        // carry everything that changed since, so the latest is enough
+        if (cache && frame && !(h.flags & FLAG_KEEPALIVE)) {
+                string_t prefix((const char *) parts[0].data(), parts[0].size());
+                auto &c = this->m_cache[prefix];
+                if (h.flags & FLAG_KEYFRAME) {
+                        copy_parts(c.key, parts);
+                        c.last.clear();
+                } else {
+                        if (!(h.flags & FLAG_TILED))
+                                c.key.clear();
+                        copy_parts(c.last, parts);
+                }
+                this->m_stats.cached = this->m_cache.size();
+        }
+
+        zmqls::send_parts(down, parts);
+}
+
+void zmqls::relay::stream::replay(zmq::socket_t &down, const string_t &topic)
+{
+        // Every replay goes to every subscriber of the topic, a crowd 
+        // joining at once gets one between them
+        auto now = chrono::steady_clock::now();
+        auto it = this->m_replays.find(topic);
+        if (it != this->m_replays.end() 
+                && now - it->second < chrono::duration<double>(this->m_replay_interval)) {
+                ++this->m_stats.replays_limited;
+                return;
+        }
+        this->m_replays[topic] = now;
+
+        parts_t parts;
+        for (auto &e : this->m_cache) {
+                if (e.first.compare(0, topic.size(), topic) != 0)
+                        continue;
+
+                for (auto *cached : {&e.second.key, &e.second.last}) {
+                        if (cached->empty())
+                                continue;
+
+                        copy_parts(parts, *cached);
+                        zmqls::send_parts(down, parts);
+                        ++this->m_stats.replayed;
+                }
+        }
+}
+
+void zmqls::relay::stream::subscription(zmq::socket_t &up, zmq::socket_t &down, 
+        zmq::message_t &m, bool verbose)
+{
+        // A 1 (subscribe) or 0 (unsubscribe) byte followed by the topic, 
+        // every subscription is seen but only the last unsubscription
+        if (m.size() == 0)
+                return;
+
+        auto data = static_cast<const char *>(m.data());
+        string_t topic(data + 1, m.size() - 1);
+        bool subscribe = data[0] == 1;
+
+        if (subscribe) {
+                this->replay(down, topic);
+
+                // Upstream only hears of a topic once
+                if (!this->m_topics.insert(topic).second)
+                        return;
+        } else {
+                if (!this->m_topics.erase(topic))
+                        return;
+                this->m_replays.erase(topic);
+
+                // Frames of prefixes nobody wants anymore would be stale 
+                // by the time someone does again
+                for (auto it = this->m_cache.begin(); it != this->m_cache.end();) {
+                        bool wanted = false;
+                        for (const auto &t : this->m_topics)
+                                wanted = wanted || it->first.compare(0, t.size(), t) == 0;
+                        it = wanted ? next(it) : this->m_cache.erase(it);
+                }
+                this->m_stats.cached = this->m_cache.size();
+        }
+
+        if (verbose) {
+                cout << this->m_name << ": " << (subscribe ? "Subscribed" : "Unsubscribed") 
+                        << " upstream: " << topic << endl;
+        }
+
+        this->m_stats.subscriptions = this->m_topics.size();
+        up.send(m);
+}
+
+nlohmann::json zmqls::relay::stream::metrics() const
+{
+        const auto &st = this->m_stats;
+
+        return {
+                {"name", this->m_name},
+                {"role", "relay"},
+                {"time_us", now_us()},
+                {"frames", st.frames.load()},
+                {"bytes", st.bytes.load()},
+                {"keepalives", st.keepalives.load()},
+                {"replayed", st.replayed.load()},
+                {"replays_limited", st.replays_limited.load()},
+                {"subscriptions", st.subscriptions.load()},
+                {"cached", st.cached.load()}
+        };
+}
+
+int zmqls::relay::stream::start(zmq::context_t &ctx)
+{
+        // To prevent searching of JSON data
+        auto upstream = this->m_json.get<string_t>(
+                "upstream", "", &zmqls::json::wrapper::is_string);
+        auto address = this->m_json.get<string_t>(
+                "address", "", &zmqls::json::wrapper::is_string);
+        auto cache = this->m_json.get<bool>(
+                "cache", true, &zmqls::json::wrapper::is_boolean);
+        auto verbose = this->m_json.get<bool>(
+                "verbose", false, &zmqls::json::wrapper::is_boolean);
+        this->m_replay_interval = this->m_json.get<double>(
+                "replay_interval", 1, &zmqls::json::wrapper::is_number);
+
+        // Sanity check
+        if (upstream.empty()) {
+                cerr << this->m_name << ": No upstream address specified" << endl;
+                return EXIT_FAILURE;
+        }
+        if (address.empty()) {
+                cerr << this->m_name << ": No address specified" << endl;
+                return EXIT_FAILURE;
+        }
+
+        // Every subscription has to be seen to replay the cache for it
+        zmq::socket_t down(ctx, ZMQ_XPUB);
+        int on = 1;
+        down.setsockopt(ZMQ_XPUB_VERBOSE, &on, sizeof(on));
+        try {
+                down.bind(address.c_str());
+        } catch (const zmq::error_t &e) {
+                cerr << this->m_name 
+                        << ": Failed to bind to given address: " 
+                        << address << endl;
+                cerr << this->m_name << ": " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+
+        // Subscriptions are passed upstream, and sent again by ZMQ 
+        // whenever it reconnects
+        zmq::socket_t up(ctx, ZMQ_XSUB);
+        try {
+                up.connect(upstream.c_str());
+        } catch (const zmq::error_t &e) {
+                cerr << this->m_name 
+                        << ": Failed to connect to given address: " 
+                        << upstream << endl;
+                cerr << this->m_name << ": " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+
+        // Export stats for monitoring if asked to
+        metrics_endpoint exporter([this]{ return this->metrics(); });
+        if (!exporter.start(ctx, this->m_json, this->m_name, cerr))
+                return EXIT_FAILURE;
+
+        if (verbose) {
+                cout << this->m_name << ": Upstream: " << upstream << endl;
+                cout << this->m_name << ": Address: " << address << endl;
+                cout << this->m_name << ": Cache: " << (cache ? "yes" : "no") << endl;
+        }
+
+        // Both directions on this thread, waking up periodically so a 
+        // stopped stream notices
+        zmq::pollitem_t items[] = {
+                {(void *) up, 0, ZMQ_POLLIN, 0},
+                {(void *) down, 0, ZMQ_POLLIN, 0}
+        };
+        parts_t parts;
+        zmq::message_t m;
+        while (this->running()) {
+                if (zmq::poll(items, 2, 100) <= 0)
+                        continue;
+
+                if (items[1].revents & ZMQ_POLLIN) {
+                        while (down.recv(&m, ZMQ_DONTWAIT))
+                                this->subscription(up, down, m, verbose);
+                }
+                if ((items[0].revents & ZMQ_POLLIN) && zmqls::recv_parts(up, parts))
+                        this->forward(down, parts, cache);
+        }
+
+        this->m_cache.clear();
+        this->m_topics.clear();
+        this->m_replays.clear();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,944 @@
+#include <zmqls/server.hpp>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/json.hpp>
+#include <zmqls/metrics.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+// Scales the frame for every wanted layer, largest first, each one from 
+// the level before it so the work shrinks along with the frames
+static void build_pyramid(zmqls::server::pyramid_t &p, const zmqls::server::layers_t &layers)
+{
+        vector<uint> order(layers.size());
+        iota(order.begin(), order.end(), 0);
+        stable_sort(order.begin(), order.end(), [&layers](uint a, uint b) {
+                return layers[a]->scale > layers[b]->scale;
+        });
+
+        cv::Mat prev = p.full;
+        for (auto i : order) {
+                if (!p.wanted[i])
+                        continue;
+
+                double s = layers[i]->scale;
+                cv::Size size(max((int) lround(p.full.cols * s), 1), 
+                        max((int) lround(p.full.rows * s), 1));
+                if (size == prev.size()) {
+                        p.levels[i] = prev;
+                        continue;
+                }
+
+                cv::resize(prev, p.levels[i], size, 0, 0, cv::INTER_AREA);
+                prev = p.levels[i];
+        }
+}
+
+// A single row of bytes, as sources in passthrough hand out JPEG
+static bool is_compressed(const cv::Mat &m)
+{
+        return m.rows == 1 && m.type() == CV_8UC1 && m.cols >= 2
+                && m.data[0] == 0xff && m.data[1] == 0xd8;
+}
+
+void zmqls::server::stream::capture(capture_state_t &s)
+{
+        // For FPS limiter
+        auto last_frame = steady_clock::now();
+        bool idling = false;
+
+        cpu_meter cpu(this->m_stats.capture_cpu_us);
+        while (this->running() && !s.out->closed()) {
+                cpu.update();
+                bool watched = s.idle == idle_t::NONE || this->m_stats.subscriptions > 0;
+
+                // Leave the source alone until someone subscribes (the
+                // publisher wakes us right away)
+                if (!watched && s.idle == idle_t::CAPTURE) {
+                        unique_lock<mutex> lock(this->m_idle_mutex);
+                        this->m_idle.wait_for(lock, milliseconds(100), [this]{ 
+                                return this->m_stats.subscriptions > 0 || !this->running(); 
+                        });
+                        idling = true;
+                        continue;
+                }
+                if (idling) {
+                        this->m_source->resume();
+                        idling = false;
+                }
+
+                // For FPS limiter
+                time_point<steady_clock> wait_until;
+                if (s.fps > 0)
+                        wait_until = last_frame + milliseconds(1000 / s.fps);
+
+                // A source that keeps grabbing has the newest frame ready 
+                // whenever an encoder is, so there is no point in 
+                // retrieving (and decoding) one any earlier
+                if (s.on_demand && !s.out->wait_empty())
+                        break;
+
+                // Read raw from the source
+                cv::Mat frame;
+                auto read_start = steady_clock::now();
+                this->m_source->read(frame);
+                int64_t capture_us = now_us();
+                this->m_stats.capture.record(duration_cast<microseconds>(
+                        steady_clock::now() - read_start).count());
+
+                // Frames are as old as the grab, not the read, if known
+                int64_t grabbed_us = this->m_source->timestamp();
+                if (grabbed_us > 0 && grabbed_us <= capture_us)
+                        capture_us = grabbed_us;
+
+                // Skip erroneous data
+                if (frame.size().width == 0)
+                        continue;
+
+                this->dispatch(s, frame, capture_us);
+
+                // For FPS limiter
+                if (s.fps > 0)
+                        this_thread::sleep_until(wait_until);
+                last_frame = steady_clock::now();
+        }
+
+        // Lets the rest of the pipeline drain and shut down
+        s.out->close();
+}
+
+void zmqls::server::stream::hub_capture(capture_state_t &s, const capture_hub &hub, 
+        cv::VideoCapture *device, int64_t grab_us)
+{
+        // Lets the rest of the pipeline drain and shut down
+        if (!this->running() || hub.failed()) {
+                s.out->close();
+                return;
+        }
+        if (!device)
+                return;
+
+        // Frames nobody watches, or that come in faster than the FPS 
+        // limit, are never retrieved, which is where decoding happens
+        if (s.idle == idle_t::CAPTURE && this->m_stats.subscriptions == 0)
+                return;
+        auto now = steady_clock::now();
+        if (s.fps > 0) {
+                if (now < s.next)
+                        return;
+                s.next = now + milliseconds(1000 / s.fps);
+        }
+
+        cv::Mat frame;
+        device->retrieve(frame);
+        this->m_stats.capture.record(duration_cast<microseconds>(
+                steady_clock::now() - now).count());
+
+        // Skip erroneous data
+        if (frame.size().width == 0)
+                return;
+
+        this->dispatch(s, frame, grab_us);
+}
+
+void zmqls::server::stream::dispatch(capture_state_t &s, const cv::Mat &frame, 
+        int64_t capture_us)
+{
+        bool watched = s.idle == idle_t::NONE || this->m_stats.subscriptions > 0;
+
+        // Straight from the camera to the publisher, there is only the 
+        // one layer at full size
+        if (s.passthrough && is_compressed(frame)) {
+                bool wanted = s.idle == idle_t::NONE 
+                        || this->m_layers[0]->subscriptions > 0;
+                cv::Size size = jpeg_size(frame.data, frame.cols);
+                if (wanted && size.area()) {
+                        frame_t f;
+                        f.header.seq = s.seq++;
+                        f.header.stream_id = s.stream_id;
+                        f.header.capture_us = capture_us;
+                        f.header.width = size.width;
+                        f.header.height = size.height;
+                        f.compressed = true;
+                        f.image = frame;
+                        this->hand_over(s, move(f));
+                } else if (wanted) {
+                        ++this->m_stats.errors;
+                }
+
+                return;
+        }
+
+        auto pyramid = make_shared<pyramid_t>();
+        pyramid->full = frame;
+
+        // Hand the frame over as one job per layer, dropping the oldest 
+        // if the encoders have fallen behind. Layers nobody is subscribed
+        // to are left out, and with them the scaling and encoding.
+        auto n = this->m_layers.size();
+        pyramid->wanted.resize(n);
+        pyramid->levels.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+                pyramid->wanted[i] = s.idle == idle_t::NONE 
+                        || this->m_layers[i]->subscriptions > 0;
+        }
+
+        // A frame that looks like the last one sent is not encoded, only 
+        // its header goes out to show the stream is still live
+        bool keepalive = false;
+        bool refresh = watched && this->m_refresh.exchange(false);
+        if (s.gate && watched) {
+                auto detect_start = steady_clock::now();
+                if (refresh)
+                        s.gate->reset();
+                keepalive = !s.gate->changed(pyramid->full);
+                this->m_stats.detect.record(duration_cast<microseconds>(
+                        steady_clock::now() - detect_start).count());
+                if (keepalive)
+                        ++this->m_stats.skipped;
+        }
+
+        if (!watched)
+                return;
+
+        for (size_t i = 0; i < n; ++i) {
+                if (!pyramid->wanted[i])
+                        continue;
+
+                frame_t f;
+                f.header.seq = s.seq;
+                f.header.stream_id = s.stream_id;
+                f.header.capture_us = capture_us;
+                f.layer = i;
+                if (keepalive) {
+                        f.header.flags |= FLAG_KEEPALIVE;
+                } else if (s.keyframe && s.keys[i] && !refresh
+                        && s.seq - s.key_seqs[i] < s.keyframe) {
+                        // Only what changed since the keyframe
+                        f.header.flags |= FLAG_TILED;
+                        f.pyramid = pyramid;
+                        f.key = s.keys[i];
+                        f.key_seq = s.key_seqs[i];
+                } else {
+                        f.pyramid = pyramid;
+                        if (s.keyframe) {
+                                f.header.flags |= FLAG_KEYFRAME;
+                                s.keys[i] = pyramid;
+                                s.key_seqs[i] = s.seq;
+                        }
+                }
+                this->hand_over(s, move(f));
+        }
+        ++s.seq;
+}
+
+void zmqls::server::stream::hand_over(capture_state_t &s, frame_t &&f)
+{
+        if (s.wait)
+                s.out->push_wait(move(f));
+        else if (!s.out->push(move(f)))
+                ++this->m_stats.dropped;
+}
+
+void zmqls::server::stream::encode(frame_queue_t &in, frame_queue_t &out,
+        encoder_pool_t &pool)
+{
+        frame_t f;
+        cpu_meter cpu(this->m_stats.encode_cpu_us);
+        while (true) {
+                cpu.update();
+
+                // Take the next frame and its place in the encode order 
+                // together, so the order has no gaps between workers
+                {
+                        lock_guard<mutex> lock(pool.mutex);
+                        if (!in.pop(f))
+                                break;
+                        f.order = pool.next[f.layer]++;
+
+                        // Frames are only as fresh as when work on them starts
+                        if (!(f.header.flags & FLAG_KEEPALIVE) && f.header.seq != pool.aged) {
+                                pool.aged = f.header.seq;
+                                this->m_stats.age.record(now_us() - f.header.capture_us);
+                        }
+                }
+
+                // Keep-alives only keep their place in the order
+                if (f.header.flags & FLAG_KEEPALIVE) {
+                        f.header.encode_us = now_us();
+                        if (!out.push(move(f)))
+                                ++this->m_stats.dropped;
+                        continue;
+                }
+
+                // Already JPEG, only moved into a buffer ZMQ can own
+                // (the camera's quality is unknown)
+                if (f.compressed) {
+                        f.data = pool.buffers->acquire();
+                        f.data->assign(f.image.data, f.image.data + f.image.cols);
+                        f.image.release();
+                        f.header.codec = codec_id::JPEG;
+                        f.header.encode_us = now_us();
+                        ++this->m_stats.passthrough;
+                        if (!out.push(move(f)))
+                                ++this->m_stats.dropped;
+                        continue;
+                }
+
+                // The first of a frame's layers to get here scales it for
+                // all of them, the others wait for that and share the result
+                auto build = [this](pyramid_t &p) {
+                        call_once(p.built, [this, &p]{
+                                auto scale_start = steady_clock::now();
+                                build_pyramid(p, this->m_layers);
+                                this->m_stats.scale.record(duration_cast<microseconds>(
+                                        steady_clock::now() - scale_start).count());
+                        });
+                };
+                build(*f.pyramid);
+                const layer_t &layer = *this->m_layers[f.layer];
+                f.image = f.pyramid->levels[f.layer];
+                f.pyramid.reset();
+
+                // A tiled frame needs its keyframe at the same scale, which 
+                // may not have been encoded yet
+                cv::Mat key;
+                if (f.key) {
+                        build(*f.key);
+                        key = f.key->levels[f.layer];
+                        f.key.reset();
+                }
+
+                // Compress and encode the raw frame into a pooled buffer, 
+                // then release it (an empty result is still passed on to 
+                // keep the order whole)
+                auto encode_start = steady_clock::now();
+                f.data = pool.buffers->acquire();
+                if (f.header.flags & FLAG_TILED) {
+                        this->m_stats.tiles += pool.tiles->encode(
+                                f.image, key, f.key_seq, *layer.codec, *f.data);
+                        ++this->m_stats.tiled;
+                } else if (!layer.codec->encode(f.image, *f.data)) {
+                        f.data->clear();
+                        ++this->m_stats.errors;
+                }
+                this->m_stats.encode.record(duration_cast<microseconds>(
+                        steady_clock::now() - encode_start).count());
+
+                f.header.codec = layer.codec->id();
+                f.header.quality = layer.codec->quality();
+                f.header.width = f.image.cols;
+                f.header.height = f.image.rows;
+                f.header.encode_us = now_us();
+                f.image.release();
+
+                if (!out.push(move(f)))
+                        ++this->m_stats.dropped;
+        }
+
+        cpu.update();
+
+        // Last worker out shuts the publisher down
+        if (--pool.running == 0)
+                out.close();
+}
+
+void zmqls::server::stream::publish(zmq::socket_t &pub, frame_queue_t &in, 
+        uint window, idle_t idle, bool verbose)
+{
+        auto last_frame = steady_clock::now();
+
+        // Frames encoded ahead of their turn wait here until the ones 
+        // before them arrive. If more than `window` frames are waiting the 
+        // missing one was dropped, or is a straggler, and is skipped. Every
+        // layer is reordered on its own, a cheap layer's frames would 
+        // otherwise overtake and skip the expensive ones (or keyframes) 
+        // still being encoded.
+        auto n = this->m_layers.size();
+        vector<map<uint64_t, frame_t>> pending(n);
+        vector<uint64_t> next(n, 0);
+
+        // Seq of the last keyframe published of every layer, and of the
+        // last one found missing
+        const uint64_t none = numeric_limits<uint64_t>::max();
+        vector<uint64_t> keys(n, none);
+        vector<uint64_t> lost(n, none);
+
+        frame_t f;
+        cpu_meter cpu(this->m_stats.publish_cpu_us);
+        while (true) {
+                cpu.update();
+
+                // Wait on subscriptions while no frames are coming (nobody
+                // is watching, and the stream does not encode regardless), 
+                // so the first one gets its frame as soon as possible, 
+                // otherwise only pick up whatever has come in
+                bool watched = idle == idle_t::NONE || this->m_stats.subscriptions > 0;
+                this->subscriptions(pub, watched ? 0 : 100, verbose);
+                if (!in.pop_for(f, milliseconds(watched ? 100 : 0))) {
+                        if (in.closed())
+                                break;
+                        continue;
+                }
+
+                // Too late, a newer frame has already been published
+                uint l = f.layer;
+                if (f.order < next[l])
+                        continue;
+
+                auto &waiting = pending[l];
+                waiting.emplace(f.order, move(f));
+                while (!waiting.empty()) {
+                        auto it = waiting.begin();
+                        if (it->first != next[l] && waiting.size() <= window)
+                                break;
+
+                        next[l] = it->first + 1;
+                        frame_t out = move(it->second);
+                        waiting.erase(it);
+
+                        bool keepalive = out.header.flags & FLAG_KEEPALIVE;
+                        if (!keepalive && (!out.data || out.data->empty()))
+                                continue;
+
+                        // Tiles are no use to clients without their keyframe,
+                        // which may have been dropped on the way (by a full
+                        // queue, the reorder window or its encoder). Have the
+                        // next frame be a keyframe instead of waiting for one.
+                        if (out.header.flags & FLAG_KEYFRAME) {
+                                keys[out.layer] = out.header.seq;
+                        } else if ((out.header.flags & FLAG_TILED) 
+                                && out.key_seq != keys[out.layer]) {
+                                if (lost[out.layer] != out.key_seq) {
+                                        lost[out.layer] = out.key_seq;
+                                        ++this->m_stats.keys_lost;
+                                        this->m_refresh = true;
+                                }
+                                continue;
+                        }
+
+                        // Send the layer's prefix and the encoded buffer 
+                        // itself, ZMQ takes a reference instead of a copy.
+                        // Same-host subscribers go first, that is cheap.
+                        auto send_start = steady_clock::now();
+                        if (this->m_shm)
+                                this->publish_shm(out);
+                        send_frame(pub, this->m_layers[out.layer]->topic, 
+                                out.header, out.data);
+                        auto next_frame = steady_clock::now();
+                        this->m_stats.publish.record(duration_cast<microseconds>(
+                                next_frame - send_start).count());
+                        if (keepalive) {
+                                ++this->m_stats.keepalives;
+                                continue;
+                        }
+                        ++this->m_stats.frames;
+                        this->m_stats.bytes += out.data->size();
+
+                        // Print stats if verbose
+                        if (verbose) {
+                                double fps = 1 / duration<double>(
+                                        next_frame - last_frame).count();
+                                cout << this->m_name << ": FPS: " << fps << endl;
+                        }
+
+                        last_frame = next_frame;
+                }
+        }
+}
+
+void zmqls::server::stream::publish_shm(const frame_t &f)
+{
+        // Keep-alives are only a header anyway
+        zmq::message_t ref;
+        if (!(f.header.flags & FLAG_KEEPALIVE)) {
+                shm_ref r;
+                if (!this->m_shm->ring.write(f.data->data(), f.data->size(), r.pos)) {
+                        ++this->m_stats.shm_skipped;
+                        return;
+                }
+                r.ring = this->m_shm->ring.id();
+                shm_ref_to_msg(ref, r);
+                ++this->m_stats.shm_frames;
+        }
+
+        const auto &p = this->m_layers[f.layer]->topic;
+        zmq::message_t prefix(p.data(), p.length());
+        zmq::message_t header;
+        header_to_msg(header, f.header);
+
+        auto &notify = *this->m_shm->notify;
+        notify.send(prefix, ZMQ_SNDMORE);
+        notify.send(header, ZMQ_SNDMORE);
+        notify.send(ref);
+}
+
+nlohmann::json zmqls::server::stream::metrics() const
+{
+        const auto &st = this->m_stats;
+
+        // Every layer's codec with its cost
+        auto layers = nlohmann::json::array();
+        for (const auto &l : this->m_layers) {
+                auto j = l->codec->metrics();
+                j["prefix"] = l->prefix;
+                j["subscriptions"] = l->subscriptions.load();
+                layers.push_back(j);
+        }
+
+        return {
+                {"name", this->m_name},
+                {"role", "server"},
+                {"time_us", now_us()},
+                {"frames", st.frames.load()},
+                {"bytes", st.bytes.load()},
+                {"dropped", st.dropped.load()},
+                {"errors", st.errors.load()},
+                {"skipped", st.skipped.load()},
+                {"keepalives", st.keepalives.load()},
+                {"tiled", st.tiled.load()},
+                {"keys_lost", st.keys_lost.load()},
+                {"tiles", st.tiles.load()},
+                {"passthrough", st.passthrough.load()},
+                {"shm_frames", st.shm_frames.load()},
+                {"shm_skipped", st.shm_skipped.load()},
+                {"subscriptions", st.subscriptions.load()},
+                {"layers", layers},
+                {"capture_age_us", histogram_to_json(st.age)},
+                {"stages_us", {
+                        {"capture", histogram_to_json(st.capture)},
+                        {"detect", histogram_to_json(st.detect)},
+                        {"scale", histogram_to_json(st.scale)},
+                        {"encode", histogram_to_json(st.encode)},
+                        {"publish", histogram_to_json(st.publish)}
+                }}
+        };
+}
+
+void zmqls::server::stream::subscriptions(zmq::socket_t &pub, long timeout, bool verbose)
+{
+        zmq::pollitem_t items[] = {
+                {(void *) pub, 0, ZMQ_POLLIN, 0},
+                {this->m_shm ? (void *) *this->m_shm->notify : nullptr, 0, ZMQ_POLLIN, 0}
+        };
+        if (zmq::poll(items, this->m_shm ? 2 : 1, timeout) <= 0)
+                return;
+
+        // Verbose XPUB passes on every subscription to a topic but only 
+        // the last unsubscription from it, each as a message of a 1 
+        // (subscribe) or 0 (unsubscribe) byte followed by the topic
+        zmq::message_t m;
+        for (auto s : {&pub, this->m_shm ? this->m_shm->notify.get() : nullptr}) {
+                while (s && s->recv(&m, ZMQ_DONTWAIT)) {
+                        if (m.size() == 0)
+                                continue;
+
+                        auto data = static_cast<const char *>(m.data());
+                        string_t topic(data + 1, m.size() - 1);
+
+                        // Whoever just subscribed has nothing to show yet
+                        if (data[0] == 1)
+                                this->m_refresh = true;
+
+                        // A layer's own topic only counts for that layer,
+                        // any other topic (such as a bare prefix) for every
+                        // layer whose frames would be delivered to it
+                        bool exact = false;
+                        for (const auto &l : this->m_layers)
+                                exact = exact || l->topic == topic;
+                        for (auto &l : this->m_layers) {
+                                if (exact ? l->topic != topic 
+                                        : l->topic.compare(0, topic.size(), topic) != 0)
+                                        continue;
+
+                                auto key = make_pair((const void *) s, topic);
+                                if (data[0] == 1)
+                                        ++l->topics[key];
+                                else if (data[0] == 0)
+                                        l->topics.erase(key);
+                        }
+                }
+        }
+
+        uint total = 0;
+        for (auto &l : this->m_layers) {
+                uint count = 0;
+                for (const auto &t : l->topics)
+                        count += t.second;
+                uint before = l->subscriptions.exchange(count);
+                total += count;
+
+                if (verbose && before == 0 && count > 0)
+                        cout << this->m_name << ": " << l->prefix << ": Subscribed" << endl;
+                else if (verbose && before > 0 && count == 0)
+                        cout << this->m_name << ": " << l->prefix << ": No subscribers" << endl;
+        }
+
+        // Wake the capture stage if it is idle
+        if (this->m_stats.subscriptions.exchange(total) == 0 && total > 0) {
+                {
+                        lock_guard<mutex> lock(this->m_idle_mutex);
+                }
+                this->m_idle.notify_all();
+        }
+}
+
+unique_ptr<zmqls::codec> zmqls::server::stream::make_layer_codec(
+        const nlohmann::json *layer)
+{
+        json_t sj(codec_settings(this->m_json, layer));
+        auto name = sj.get<string_t>("codec", "jpeg", &zmqls::json::wrapper::is_string);
+        auto ret = make_codec(name, sj);
+        if (!ret) {
+                cerr << this->m_name << ": Unknown codec: " << name << " (available:";
+                for (const auto &n : codec_names())
+                        cerr << " " << n;
+                cerr << ")" << endl;
+                return ret;
+        }
+
+        // Not every backend honours the subsampling, so see what a tiny
+        // image actually comes out as rather than find out from clients
+        auto sub = sj.get<string_t>("subsampling", "", &zmqls::json::wrapper::is_string);
+        if (!sub.empty() && ret->id() == codec_id::JPEG) {
+                buffer_t out;
+                string got = ret->encode(cv::Mat(16, 16, CV_8UC3, cv::Scalar::all(128)), out)
+                        ? jpeg_subsampling(out.data(), out.size()) : "";
+                if (got != sub)
+                        cerr << this->m_name << ": Subsampling " << sub 
+                                << " is not honoured by the " << ret->name() 
+                                << " codec here (encodes " 
+                                << (got.empty() ? "unknown" : got) << ")" << endl;
+        }
+
+        return ret;
+}
+
+const char *zmqls::server::stream::passthrough_blocker() const
+{
+        const auto &l = *this->m_layers.front();
+        if (this->m_layers.size() > 1 || l.scale != 1)
+                return "layers";
+        if (l.codec->id() != codec_id::JPEG)
+                return "codec";
+        // Explicit settings have to be re-encoded to
+        for (const char *key : {"encode", "subsampling", "fast_dct"}) {
+                if (this->m_json.get(key))
+                        return key;
+        }
+        if (this->m_json.get("gate"))
+                return "gate";
+        if (this->m_json.get("tiles"))
+                return "tiles";
+
+        return nullptr;
+}
+
+bool zmqls::server::stream::make_layers(const string_t &prefix)
+{
+        this->m_layers.clear();
+
+        // Without "layers", only the captured frame as it is
+        auto olayers = this->m_json.get("layers");
+        if (!olayers || !olayers->is_array()) {
+                this->m_layers.emplace_back(new layer_t);
+                auto &l = *this->m_layers.back();
+                l.prefix = prefix;
+                l.topic = topic(prefix);
+                l.codec = this->make_layer_codec(nullptr);
+
+                return (bool) l.codec;
+        }
+
+        for (const auto &o : *olayers) {
+                if (!o.is_object()) {
+                        cerr << this->m_name << ": Invalid layer" << endl;
+                        return false;
+                }
+
+                json_t lj(o);
+                auto suffix = lj.get<string_t>(
+                        "suffix", "", &zmqls::json::wrapper::is_string);
+                auto scale = lj.get<double>(
+                        "scale", 1, &zmqls::json::wrapper::is_number);
+                if (scale <= 0 || scale > 1) {
+                        cerr << this->m_name << ": Layer scale must be above 0 and at most 1: " 
+                                << prefix + suffix << endl;
+                        return false;
+                }
+
+                this->m_layers.emplace_back(new layer_t);
+                auto &l = *this->m_layers.back();
+                l.prefix = prefix + suffix;
+                l.topic = topic(l.prefix);
+                l.scale = scale;
+                l.codec = this->make_layer_codec(&o);
+                if (!l.codec)
+                        return false;
+        }
+
+        if (this->m_layers.empty()) {
+                cerr << this->m_name << ": No layers specified" << endl;
+                return false;
+        }
+
+        return true;
+}
+
+int zmqls::server::stream::start(zmq::context_t &ctx)
+{
+        // To prevent searching of JSON data
+        auto address = this->m_json.get<string_t>(
+                "address", "", &zmqls::json::wrapper::is_string);
+        auto prefix = this->m_json.get<string_t> (
+                "prefix", "", &zmqls::json::wrapper::is_string);
+        auto fps = this->m_json.get<uint>(
+                "fps", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto verbose = this->m_json.get<bool>(
+                "verbose", false, &zmqls::json::wrapper::is_boolean);
+        auto queue_depth = this->m_json.get<uint>(
+                "queue", 2, &zmqls::json::wrapper::is_number_unsigned);
+        auto idle_name = this->m_json.get<string_t>(
+                "idle", "encode", &zmqls::json::wrapper::is_string);
+        auto hub_name = this->m_json.get<string_t>(
+                "hub", "", &zmqls::json::wrapper::is_string);
+        auto backpressure = this->m_json.get<bool>(
+                "backpressure", false, &zmqls::json::wrapper::is_boolean);
+        auto latest = this->m_json.get<bool>(
+                "latest", false, &zmqls::json::wrapper::is_boolean);
+        auto oshm = this->m_json.get("shm");
+
+        // Sanity check
+        if (address.empty()) {
+                cerr << this->m_name << ": No address specified" << endl;
+                return EXIT_FAILURE;
+        }
+        if (prefix.empty()) {
+                cerr << this->m_name << ": No prefix specified" << endl;
+                return EXIT_FAILURE;
+        }
+        idle_t idle;
+        if (idle_name == "none") {
+                idle = idle_t::NONE;
+        } else if (idle_name == "encode") {
+                idle = idle_t::ENCODE;
+        } else if (idle_name == "capture") {
+                idle = idle_t::CAPTURE;
+        } else {
+                cerr << this->m_name << ": Unknown idle mode: " << idle_name << endl;
+                return EXIT_FAILURE;
+        }
+        if (!this->make_layers(prefix))
+                return EXIT_FAILURE;
+
+        // Unchanged frames are skipped if asked to
+        unique_ptr<change_detector> gate;
+        auto ogate = this->m_json.get("gate");
+        if (ogate && ogate->is_object()) {
+                json_t gj(*ogate);
+                gate.reset(new change_detector(
+                        gj.get<uint>("width", 64, &zmqls::json::wrapper::is_number_unsigned),
+                        gj.get<double>("threshold", 2, &zmqls::json::wrapper::is_number),
+                        gj.get<uint>("max_skip", 30, &zmqls::json::wrapper::is_number_unsigned)));
+        }
+
+        // Frames between keyframes only carry the tiles that changed if
+        // asked to
+        unique_ptr<tile_encoder> tiles;
+        uint keyframe = 0;
+        auto otiles = this->m_json.get("tiles");
+        if (otiles && otiles->is_object()) {
+                json_t tj(*otiles);
+                tiles.reset(new tile_encoder(
+                        tj.get<uint>("size", 64, &zmqls::json::wrapper::is_number_unsigned),
+                        tj.get<double>("threshold", 2, &zmqls::json::wrapper::is_number)));
+                keyframe = max(tj.get<uint>(
+                        "keyframe", 60, &zmqls::json::wrapper::is_number_unsigned), 1u);
+        }
+
+        // Layers are encoded in parallel by default
+        auto encoders = this->m_json.get<uint>("encoders", this->m_layers.size(), 
+                &zmqls::json::wrapper::is_number_unsigned);
+
+        // Create the socket (ZMQ sockets are NOT thread-safe, 
+        // only the publisher stage touches it from here on). XPUB lets 
+        // the publisher see who is subscribed.
+        zmq::socket_t pub(ctx, ZMQ_XPUB);
+        // Every subscription, so each new subscriber gets a whole frame
+        int on = 1;
+        pub.setsockopt(ZMQ_XPUB_VERBOSE, &on, sizeof(on));
+
+        // Try binding to the address given to us 
+        // (will fail if not enough permission, invalid, etc.)
+        try {
+                pub.bind(address.c_str());
+        } catch (const zmq::error_t &e) {
+                cerr << this->m_name 
+                        << ": Failed to bind to given address: " 
+                        << address << endl;
+                cerr << this->m_name << ": " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+
+        // Same-host subscribers read frames from shared memory if asked
+        // to, and only get notified of them through ZMQ
+        this->m_shm.reset();
+        if (oshm && oshm->is_object()) {
+                json_t shj(*oshm);
+                auto name = shj.get<string_t>(
+                        "name", "", &zmqls::json::wrapper::is_string);
+                auto notify = shj.get<string_t>(
+                        "address", "", &zmqls::json::wrapper::is_string);
+                auto slots = shj.get<uint>(
+                        "slots", 8, &zmqls::json::wrapper::is_number_unsigned);
+                auto slot_size = shj.get<uint>(
+                        "slot_size", 4 << 20, &zmqls::json::wrapper::is_number_unsigned);
+                if (name.empty() || notify.empty()) {
+                        cerr << this->m_name << ": Shared memory needs a name and an address" << endl;
+                        return EXIT_FAILURE;
+                }
+
+                this->m_shm.reset(new shm_link_t);
+                if (!this->m_shm->ring.create(name, slots, slot_size)) {
+                        cerr << this->m_name << ": Failed to create shared memory: " 
+                                << name << endl;
+                        return EXIT_FAILURE;
+                }
+                this->m_shm->notify.reset(new zmq::socket_t(ctx, ZMQ_XPUB));
+                this->m_shm->notify->setsockopt(ZMQ_XPUB_VERBOSE, &on, sizeof(on));
+                try {
+                        this->m_shm->notify->bind(notify.c_str());
+                } catch (const zmq::error_t &e) {
+                        cerr << this->m_name 
+                                << ": Failed to bind to given address: " 
+                                << notify << endl;
+                        cerr << this->m_name << ": " << e.what() << endl;
+                        return EXIT_FAILURE;
+                }
+        }
+
+        // Try opening the frame source (a capture device unless the 
+        // stream asks for a synthetic or file-backed one)
+        this->m_source = make_source(this->m_json);
+        if (!this->m_source) {
+                cerr << this->m_name << ": Unknown source type" << endl;
+                return EXIT_FAILURE;
+        }
+        if (!this->m_source->open(cerr, this->m_name, verbose))
+                return EXIT_FAILURE;
+
+        // JPEG from the camera is published as it is, unless the stream
+        // needs the pixels. Frames the source decodes anyway (not every
+        // backend can hand out JPEG) still go through the encoders.
+        bool passthrough = !this->passthrough_blocker() && this->m_source->passthrough();
+        if (verbose && passthrough)
+                cout << this->m_name << ": Publishing mjpeg as it is" << endl;
+
+        // Streams naming the same hub share a single thread waiting on 
+        // their devices, each retrieves its frames on a thread of its own
+        shared_ptr<capture_hub> hub;
+        cv::VideoCapture *device = nullptr;
+        if (!hub_name.empty()) {
+                device = this->m_source->video_capture();
+                if (!device) {
+                        cerr << this->m_name << ": Only capture devices without "
+                                << "\"latest\" can share a hub" << endl;
+                        return EXIT_FAILURE;
+                }
+                hub = capture_hub::get(hub_name);
+        }
+
+        // Export stats for monitoring if asked to
+        metrics_endpoint exporter([this]{ return this->metrics(); });
+        if (!exporter.start(ctx, this->m_json, this->m_name, cerr))
+                return EXIT_FAILURE;
+
+        // Zero encoders means one per core
+        if (encoders == 0)
+                encoders = max(thread::hardware_concurrency(), 1u);
+
+        // Stages are connected by bounded queues which drop the oldest frame 
+        // when full, so a slow encoder or socket never blocks the camera 
+        // (unless capture is to wait for the encoders). 
+        // Every frame is a job for each of its layers. A device that 
+        // keeps grabbing is only read from when the encoders want the 
+        // next frame, so captured frames never queue up.
+        size_t jobs = this->m_layers.size();
+        frame_queue_t captured((latest ? 1 : queue_depth) * jobs);
+        frame_queue_t encoded((queue_depth + encoders) * jobs);
+
+        capture_state_t state;
+        state.out = &captured;
+        state.fps = fps;
+        state.idle = idle;
+        state.gate = gate.get();
+        state.keyframe = keyframe;
+        state.passthrough = passthrough;
+        // Waiting on a hub only holds up this stream's own device, which
+        // the hub leaves alone until it has been retrieved from
+        state.wait = backpressure || latest;
+        state.on_demand = latest;
+        state.stream_id = new_stream_id();
+        state.keys.resize(jobs);
+        state.key_seqs.resize(jobs);
+
+        thread capture_thread;
+        uint64_t hub_id = 0;
+        if (hub) {
+                hub_id = hub->add(*device, [this, &state, &hub](
+                        cv::VideoCapture *d, int64_t grab_us) {
+                        this->hub_capture(state, *hub, d, grab_us);
+                });
+        } else {
+                capture_thread = thread(&stream::capture, this, ref(state));
+        }
+
+        // Consecutive frames are encoded concurrently by a pool of workers
+        encoder_pool_t pool;
+        pool.running = encoders;
+        pool.next.resize(jobs);
+        pool.buffers = buffer_pool::create(2 * (queue_depth + encoders) * jobs);
+        pool.tiles = tiles.get();
+        vector<thread> encode_threads;
+        for (uint i = 0; i < encoders; ++i) {
+                encode_threads.emplace_back(&stream::encode, this, 
+                        ref(captured), ref(encoded), ref(pool));
+        }
+
+        // Publish in capture order on this thread until the pipeline shuts down
+        this->publish(pub, encoded, encoders, idle, verbose);
+
+        captured.close();
+        encoded.close();
+        if (hub)
+                hub->remove(hub_id);
+        else
+                capture_thread.join();
+        for (auto &t : encode_threads)
+                t.join();
+        this->m_shm.reset();
+
+        if (hub && hub->failed()) {
+                cerr << this->m_name << ": Capture hub failed, "
+                        << "its devices cannot be waited on (V4L2 only)" << endl;
+                return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}
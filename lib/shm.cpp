@@ -0,0 +1,194 @@
+#include <zmqls/shm.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zmqls/header.hpp>
+
+// Layout of the shared memory, every part on a cache line of its own:
+//
+//   ring_t, then `slots` times slot_t followed by `slot_size` bytes
+//
+// A slot's tag is odd while the frame at its position is being written 
+// and even once it is done, readers compare it against the position they
+// were told about before and after using the frame.
+namespace {
+        constexpr uint32_t MAGIC = 0x7a6d6c73; // "zmls"
+        constexpr uint32_t VERSION = 1;
+        constexpr std::size_t LINE = 64;
+
+        struct ring_t {
+                uint32_t magic;
+                uint32_t version;
+                uint64_t id;
+                uint64_t slots;
+                uint64_t slot_size;
+        };
+
+        struct slot_t {
+                std::atomic<uint64_t> tag;
+                uint64_t size;
+        };
+
+        static_assert(sizeof(ring_t) <= LINE && sizeof(slot_t) <= LINE, 
+                "Ring parts have to fit in a cache line");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, 
+                "Tags are shared between processes");
+
+        inline uint64_t written(uint64_t pos) { return 2 * pos + 2; }
+}
+
+bool zmqls::shm_ring::create(const std::string &name, uint slots, 
+        std::size_t slot_size)
+{
+        this->close();
+        if (name.empty() || !slots || !slot_size)
+                return false;
+
+        // Anything left over by a previous run is stale
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+                return false;
+
+        std::size_t stride = LINE + (slot_size + LINE - 1) / LINE * LINE;
+        std::size_t size = LINE + slots * stride;
+        void *p = MAP_FAILED;
+        if (ftruncate(fd, (off_t) size) == 0)
+                p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+                shm_unlink(name.c_str());
+                return false;
+        }
+
+        // Fresh memory is zeroed, which makes for tags of no frame yet
+        auto r = static_cast<ring_t *>(p);
+        r->version = VERSION;
+        r->id = (uint64_t) now_us();
+        r->slots = slots;
+        r->slot_size = slot_size;
+        std::atomic_thread_fence(std::memory_order_release);
+        r->magic = MAGIC;
+
+        this->m_name = name;
+        this->m_owner = true;
+        this->m_base = static_cast<uint8_t *>(p);
+        this->m_size = size;
+        this->m_slots = slots;
+        this->m_slot_size = slot_size;
+        this->m_stride = stride;
+        this->m_next = 0;
+
+        return true;
+}
+
+bool zmqls::shm_ring::open(const std::string &name)
+{
+        this->close();
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+                return false;
+
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (std::size_t) st.st_size >= LINE)
+                p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+                return false;
+
+        // Only a complete ring of a version this build understands
+        auto r = static_cast<const ring_t *>(p);
+        std::size_t stride = LINE + (r->slot_size + LINE - 1) / LINE * LINE;
+        if (r->magic != MAGIC || r->version != VERSION || !r->slots
+                || LINE + r->slots * stride > (std::size_t) st.st_size) {
+                munmap(p, st.st_size);
+                return false;
+        }
+
+        this->m_name = name;
+        this->m_owner = false;
+        this->m_base = static_cast<uint8_t *>(p);
+        this->m_size = st.st_size;
+        this->m_slots = r->slots;
+        this->m_slot_size = r->slot_size;
+        this->m_stride = stride;
+
+        return true;
+}
+
+void zmqls::shm_ring::close()
+{
+        if (!this->m_base)
+                return;
+
+        munmap(this->m_base, this->m_size);
+        if (this->m_owner)
+                shm_unlink(this->m_name.c_str());
+
+        this->m_base = nullptr;
+        this->m_owner = false;
+}
+
+uint64_t zmqls::shm_ring::id() const
+{
+        return this->m_base ? reinterpret_cast<const ring_t *>(this->m_base)->id : 0;
+}
+
+uint8_t *zmqls::shm_ring::slot(uint64_t pos) const
+{
+        return this->m_base + LINE + (pos % this->m_slots) * this->m_stride;
+}
+
+bool zmqls::shm_ring::write(const uint8_t *d, std::size_t sz, uint64_t &pos)
+{
+        if (!this->m_owner || sz > this->m_slot_size)
+                return false;
+
+        // Tags are made from positions, so they never repeat
+        pos = this->m_next++;
+
+        auto s = reinterpret_cast<slot_t *>(this->slot(pos));
+        s->tag.store(written(pos) - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s->size = sz;
+        memcpy(this->slot(pos) + LINE, d, sz);
+        s->tag.store(written(pos), std::memory_order_release);
+
+        return true;
+}
+
+const uint8_t *zmqls::shm_ring::read(uint64_t pos, std::size_t &sz) const
+{
+        if (!this->m_base)
+                return nullptr;
+
+        auto s = reinterpret_cast<const slot_t *>(this->slot(pos));
+        if (s->tag.load(std::memory_order_acquire) != written(pos))
+                return nullptr;
+
+        sz = s->size;
+        if (sz > this->m_slot_size)
+                return nullptr;
+
+        return this->slot(pos) + LINE;
+}
+
+bool zmqls::shm_ring::valid(uint64_t pos) const
+{
+        if (!this->m_base)
+                return false;
+
+        auto s = reinterpret_cast<const slot_t *>(this->slot(pos));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return s->tag.load(std::memory_order_relaxed) == written(pos);
+}
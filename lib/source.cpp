@@ -0,0 +1,459 @@
+#include <zmqls/source.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/header.hpp>
+
+std::unique_ptr<zmqls::server::source> zmqls::server::make_source(const source::json_t &j)
+{
+        auto osource = j.get("source");
+        if (!osource || !osource->is_object())
+                return std::make_unique<device_source>(j);
+
+        source::json_t sj(*osource);
+        auto type = sj.get<std::string>(
+                "type", "", &zmqls::json::wrapper::is_string);
+        if (type == "pattern")
+                return std::make_unique<pattern_source>(sj);
+        if (type == "file")
+                return std::make_unique<file_source>(sj);
+        if (type == "memory")
+                return std::make_unique<memory_source>(sj);
+        if (type == "device")
+                return std::make_unique<device_source>(sj);
+
+        return nullptr;
+}
+
+void zmqls::server::paced_source::pace()
+{
+        using namespace std::chrono;
+
+        if (this->m_fps <= 0)
+                return;
+
+        // Keep to a fixed schedule, but never try to catch up on a backlog
+        auto now = steady_clock::now();
+        if (this->m_next > now)
+                std::this_thread::sleep_until(this->m_next);
+        else
+                this->m_next = now;
+        this->m_next += duration_cast<steady_clock::duration>(
+                duration<double>(1.0 / this->m_fps));
+}
+
+bool zmqls::server::device_source::open_device()
+{
+        bool ret = false;
+        auto odevice = this->m_json.get("device");
+        if (odevice) {
+                if (odevice->is_number_unsigned())
+                        ret = this->device.open(odevice->get<uint>());
+                else if (odevice->is_string())
+                        ret = this->device.open(odevice->get<string_t>());
+        }
+
+        return ret;
+}
+
+zmqls::server::device_source::update_result_t 
+zmqls::server::device_source::update_device(int id, bool (*check)(double))
+{
+        if (!this->device.isOpened())
+                return update_result_t::NOT_OPEN;
+
+        auto id_name = ::zmqls::server::device_settings::get_name(id);
+        if (!id_name)
+                return update_result_t::NOT_FOUND;
+        
+        auto id_obj = this->m_json.get(id_name);
+        if (!id_obj)
+                return update_result_t::NOT_FOUND;
+
+        double val = id_obj->get<double>();
+        if (!check(val))
+                return update_result_t::USING_DEFAULT;
+        
+        return this->device.set(id, val) ? update_result_t::OK : update_result_t::NOT_SUPPORTED;
+}
+
+void zmqls::server::device_source::update_all_settings(std::ostream &os, 
+        const string_t &name, bool verbose)
+{
+        // Loop through settings and update the device
+        auto zd_beg = std::begin(zmqls::server::device_settings::zero_default);
+        auto zd_end = std::end(zmqls::server::device_settings::zero_default);
+        for (const auto &s : zmqls::server::device_settings::lookup) {
+                using ur = update_result_t;
+                ur result;
+                if (std::find(zd_beg, zd_end, s.id) != zd_end) {
+                        result = this->update_device(
+                                s.id, [](double d){ return d > 0; });
+                } else {
+                        result = this->update_device(s.id);
+                }
+
+                if (result == ur::OK && verbose) {
+                        os << name << ": " << s.name << " OK" << std::endl;
+                } else {
+                        switch (result) {
+                        case ur::USING_DEFAULT:
+                                if (verbose) {
+                                        os << name 
+                                                << ": Using default value for "
+                                                << s.name << std::endl;
+                                }
+                                break;
+                        case ur::NOT_FOUND:
+                                if (verbose) {
+                                        os << name 
+                                                << ": Unable to find " 
+                                                << s.name << std::endl;
+                                }
+                                break;
+                        case ur::NOT_SUPPORTED:
+                                os << name 
+                                        << ": Device does not support " 
+                                        << s.name << std::endl;
+                                break;
+                        case ur::NOT_OPEN:
+                                os << name 
+                                        << ": Device is not open" << std::endl;
+                                break;
+                        }
+                }
+        }
+}
+
+bool zmqls::server::device_source::open(std::ostream &os, const string_t &name, 
+        bool verbose)
+{
+        // Try opening the device specified
+        if (!this->open_device()) {
+                os << name << ": Failed to open device" << std::endl;
+                return false;
+        }
+
+        // The pixel format has to be picked before the frame size
+        if (this->m_json.get<bool>("mjpeg", false, &zmqls::json::wrapper::is_boolean)
+                && !this->device.set(cv::CAP_PROP_FOURCC, 
+                        cv::VideoWriter::fourcc('M', 'J', 'P', 'G'))) {
+                os << name << ": Device does not support mjpeg" << std::endl;
+        }
+
+        // Update the device settings with given values or defaults
+        this->update_all_settings(os, name, verbose);
+
+        if (this->m_json.get<bool>("latest", false, &zmqls::json::wrapper::is_boolean)) {
+                this->m_running = true;
+                this->m_grabber = std::thread(&device_source::grab, this);
+                if (verbose)
+                        os << name << ": Grabbing in the background" << std::endl;
+        }
+
+        return true;
+}
+
+zmqls::server::device_source::~device_source()
+{
+        {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_running = false;
+        }
+        this->m_wake.notify_all();
+
+        if (this->m_grabber.joinable())
+                this->m_grabber.join();
+}
+
+void zmqls::server::device_source::grab()
+{
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        while (this->m_running) {
+                // A frame nobody has retrieved yet is only given up for a 
+                // newer one if read() is not already waiting to take it
+                this->m_wake.wait(lock, [this]{
+                        return !this->m_running 
+                                || !(this->m_reading && this->m_grabs > this->m_read);
+                });
+                if (!this->m_running)
+                        break;
+
+                bool ok = this->device.grab();
+                if (ok) {
+                        this->m_grab_us = now_us();
+                        ++this->m_grabs;
+                }
+                this->m_wake.notify_all();
+
+                // Don't spin on a device that has gone away
+                if (!ok) {
+                        lock.unlock();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        lock.lock();
+                }
+        }
+}
+
+bool zmqls::server::device_source::passthrough()
+{
+        if (!this->device.isOpened() || !this->m_json.get<bool>(
+                "mjpeg", false, &zmqls::json::wrapper::is_boolean))
+                return false;
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        if ((int) this->device.get(cv::CAP_PROP_FOURCC) 
+                != cv::VideoWriter::fourcc('M', 'J', 'P', 'G'))
+                return false;
+
+        // Not every backend honours this, frames are checked as they come
+        return this->device.set(cv::CAP_PROP_CONVERT_RGB, 0);
+}
+
+bool zmqls::server::device_source::read(cv::Mat &m)
+{
+        // Retrieve the newest frame the grabber got, waiting for one if
+        // it has been retrieved already
+        if (this->m_grabber.joinable()) {
+                this->m_reading = true;
+                std::unique_lock<std::mutex> lock(this->m_mutex);
+                bool fresh = this->m_wake.wait_for(lock, std::chrono::seconds(1), [this]{
+                        return this->m_grabs > this->m_read || !this->m_running;
+                });
+                this->m_reading = false;
+                if (!fresh || !this->m_running) {
+                        this->m_wake.notify_all();
+                        return false;
+                }
+
+                this->m_read = this->m_grabs;
+                this->m_timestamp = this->m_grab_us;
+                bool ret = this->device.retrieve(m);
+                lock.unlock();
+                this->m_wake.notify_all();
+
+                return ret;
+        }
+
+        // Read raw from camera
+        if (this->m_grabbed) {
+                this->m_grabbed = false;
+                return this->device.retrieve(m);
+        }
+
+        return this->device.read(m);
+}
+
+void zmqls::server::device_source::resume()
+{
+        using namespace std::chrono;
+
+        // The grabber never lets anything go stale
+        if (this->m_grabber.joinable())
+                return;
+
+        // The driver kept filling its buffers while nobody was reading, 
+        // drop those stale frames. A grab that has to wait for the camera
+        // means the buffers are empty, the frame it got is kept for read().
+        for (int i = 0; i < 8; ++i) {
+                auto start = steady_clock::now();
+                this->m_grabbed = this->device.grab();
+                if (!this->m_grabbed || steady_clock::now() - start > milliseconds(2))
+                        break;
+        }
+}
+
+zmqls::server::pattern_source::pattern_source(const json_t &j):
+        paced_source(j.get<double>("fps", 30, &zmqls::json::wrapper::is_number)),
+        m_size(j.get<uint>("width", 1280, &zmqls::json::wrapper::is_number_unsigned),
+                j.get<uint>("height", 720, &zmqls::json::wrapper::is_number_unsigned)),
+        m_motion(j.get<uint>("motion", 4, &zmqls::json::wrapper::is_number_unsigned)),
+        m_noise(j.get<uint>("noise", 0, &zmqls::json::wrapper::is_number_unsigned)),
+        m_rng(j.get<uint>("seed", 1, &zmqls::json::wrapper::is_number_unsigned)) { }
+
+bool zmqls::server::pattern_source::open(std::ostream &os, const string_t &name, 
+        bool verbose)
+{
+        if (!this->m_size.area()) {
+                os << name << ": Invalid pattern size" << std::endl;
+                return false;
+        }
+
+        // Classic colour bars (BGR order)
+        static const cv::Scalar bars[] = {
+                {192, 192, 192}, {0, 192, 192}, {192, 192, 0}, {0, 192, 0},
+                {192, 0, 192}, {0, 0, 192}, {192, 0, 0}, {16, 16, 16}
+        };
+        constexpr int n = sizeof(bars) / sizeof(bars[0]);
+
+        this->m_base.create(this->m_size, CV_8UC3);
+        int w = this->m_size.width;
+        for (int i = 0; i < n; ++i) {
+                cv::rectangle(this->m_base, 
+                        cv::Rect(i * w / n, 0, (i + 1) * w / n - i * w / n, 
+                                this->m_size.height), 
+                        bars[i], cv::FILLED);
+        }
+
+        if (this->m_noise)
+                this->m_noise_frame.create(this->m_size, CV_8UC3);
+
+        if (verbose) {
+                os << name << ": Pattern " << w << "x" << this->m_size.height 
+                        << ", motion " << this->m_motion 
+                        << ", noise " << this->m_noise << std::endl;
+        }
+
+        return true;
+}
+
+bool zmqls::server::pattern_source::read(cv::Mat &m)
+{
+        this->pace();
+
+        // Frames go down the pipeline, so every one needs its own memory
+        m = this->m_base.clone();
+
+        // A box bouncing across the frame gives the encoder some motion
+        int side = std::max(this->m_size.height / 4, 1);
+        int range = std::max(this->m_size.width - side, 1);
+        int x = (int) ((this->m_count * this->m_motion) % (2 * range));
+        if (x >= range)
+                x = 2 * range - x;
+        cv::rectangle(m, cv::Rect(x, (this->m_size.height - side) / 2, side, side), 
+                cv::Scalar(255, 255, 255), cv::FILLED);
+
+        // Noise is what makes frames expensive to compress
+        if (this->m_noise) {
+                this->m_rng.fill(this->m_noise_frame, cv::RNG::UNIFORM, 
+                        cv::Scalar::all(0), cv::Scalar::all(this->m_noise));
+                cv::add(m, this->m_noise_frame, m);
+        }
+
+        ++this->m_count;
+
+        return true;
+}
+
+zmqls::server::file_source::file_source(const json_t &j):
+        paced_source(j.get<double>("fps", 30, &zmqls::json::wrapper::is_number)),
+        m_path(j.get<string_t>("path", "", &zmqls::json::wrapper::is_string)) { }
+
+bool zmqls::server::file_source::open(std::ostream &os, const string_t &name, 
+        bool verbose)
+{
+        if (this->m_path.empty()) {
+                os << name << ": No file path specified" << std::endl;
+                return false;
+        }
+
+        // A glob pattern is an image sequence, anything else a video
+        if (this->m_path.find_first_of("*?") != string_t::npos) {
+                cv::glob(this->m_path, this->m_images);
+                std::sort(this->m_images.begin(), this->m_images.end());
+                if (this->m_images.empty()) {
+                        os << name << ": No images match " << this->m_path << std::endl;
+                        return false;
+                }
+        } else if (!this->m_video.open(this->m_path)) {
+                os << name << ": Failed to open " << this->m_path << std::endl;
+                return false;
+        }
+
+        if (verbose) {
+                os << name << ": Playing " << this->m_path;
+                if (!this->m_images.empty())
+                        os << " (" << this->m_images.size() << " images)";
+                os << std::endl;
+        }
+
+        return true;
+}
+
+bool zmqls::server::file_source::read(cv::Mat &m)
+{
+        this->pace();
+
+        if (!this->m_images.empty()) {
+                m = cv::imread(this->m_images[this->m_next]);
+                this->m_next = (this->m_next + 1) % this->m_images.size();
+                return !m.empty();
+        }
+
+        // Rewind once the end of the video is reached
+        if (this->m_video.read(m))
+                return true;
+        this->m_video.set(cv::CAP_PROP_POS_FRAMES, 0);
+
+        return this->m_video.read(m);
+}
+
+zmqls::server::memory_source::memory_source(const json_t &j):
+        paced_source(j.get<double>("fps", 30, &zmqls::json::wrapper::is_number)),
+        m_count(j.get<uint>("frames", 30, &zmqls::json::wrapper::is_number_unsigned))
+{
+        // The inner source is described like a stream's "source", and 
+        // preloading should not be held back by its pace
+        auto ofrom = j.get("from");
+        if (ofrom && ofrom->is_object()) {
+                ::nlohmann::json wrapped;
+                wrapped["source"] = *ofrom;
+                wrapped["source"]["fps"] = 0;
+                this->m_from = make_source(json_t(wrapped));
+        }
+}
+
+bool zmqls::server::memory_source::open(std::ostream &os, const string_t &name, 
+        bool verbose)
+{
+        if (!this->m_from || !this->m_count) {
+                os << name << ": Memory source needs \"from\" and \"frames\"" 
+                        << std::endl;
+                return false;
+        }
+        if (!this->m_from->open(os, name, verbose))
+                return false;
+
+        // Preload every frame up front, skipping empty reads
+        this->m_frames.reserve(this->m_count);
+        uint misses = 0;
+        while (this->m_frames.size() < this->m_count && misses < this->m_count) {
+                cv::Mat m;
+                if (this->m_from->read(m) && !m.empty())
+                        this->m_frames.push_back(m);
+                else
+                        ++misses;
+        }
+
+        // Nothing reads from the inner source from here on
+        this->m_from.reset();
+
+        if (this->m_frames.empty()) {
+                os << name << ": Failed to preload any frames" << std::endl;
+                return false;
+        }
+        if (verbose) {
+                os << name << ": Preloaded " << this->m_frames.size() 
+                        << " frames" << std::endl;
+        }
+
+        return true;
+}
+
+bool zmqls::server::memory_source::read(cv::Mat &m)
+{
+        this->pace();
+
+        m = this->m_frames[this->m_next];
+        this->m_next = (this->m_next + 1) % this->m_frames.size();
+
+        return true;
+}
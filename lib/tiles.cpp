@@ -0,0 +1,124 @@
+#include <zmqls/tiles.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <zmqls/header.hpp>
+
+std::size_t zmqls::tile_encoder::encode(const cv::Mat &frame, const cv::Mat &key, 
+        uint64_t key_seq, codec &c, buffer_t &out) const
+{
+        int s = (int) this->m_size;
+        int cols = (frame.cols + s - 1) / s;
+        int rows = (frame.rows + s - 1) / s;
+        bool all = frame.size() != key.size() || frame.type() != key.type();
+
+        // Find the tiles that changed, each compared in place
+        tile_table t;
+        t.key_seq = key_seq;
+        t.tile_width = t.tile_height = (uint16_t) s;
+        std::vector<cv::Rect> rects;
+        for (int r = 0; r < rows; ++r) {
+                for (int c = 0; c < cols; ++c) {
+                        cv::Rect rect(c * s, r * s, 
+                                std::min(s, frame.cols - c * s), 
+                                std::min(s, frame.rows - r * s));
+                        if (!all) {
+                                double d = cv::norm(frame(rect), key(rect), cv::NORM_L1)
+                                        / (rect.area() * frame.channels());
+                                if (d <= this->m_threshold)
+                                        continue;
+                        }
+
+                        tile_table::tile_t tile;
+                        tile.col = (uint16_t) c;
+                        tile.row = (uint16_t) r;
+                        t.tiles.push_back(tile);
+                        rects.push_back(rect);
+                }
+        }
+
+        // Tiles go after the table, which is written last once their 
+        // sizes are known
+        thread_local std::vector<uint8_t> encoded;
+        out.resize(tile_table::size(t.tiles.size()));
+        for (std::size_t i = 0; i < rects.size(); ++i) {
+                if (!c.encode(frame(rects[i]), encoded))
+                        encoded.clear();
+                t.tiles[i].size = (uint32_t) encoded.size();
+                out.insert(out.end(), encoded.begin(), encoded.end());
+        }
+        write_tile_table(out.data(), t);
+
+        return t.tiles.size();
+}
+
+cv::Rect zmqls::canvas::tile_rect(int col, int row) const
+{
+        cv::Rect rect(col * this->m_tile.width, row * this->m_tile.height, 
+                this->m_tile.width, this->m_tile.height);
+
+        return rect & cv::Rect(0, 0, this->m_key.cols, this->m_key.rows);
+}
+
+void zmqls::canvas::key(const cv::Mat &frame, uint64_t seq)
+{
+        this->m_key = frame;
+        this->m_canvas = frame;
+        this->m_key_seq = seq;
+        this->m_valid = !frame.empty();
+        this->m_shared = true;
+        this->m_dirty.clear();
+}
+
+bool zmqls::canvas::composite(const tile_table &t, const uint8_t *d, codec &c)
+{
+        if (!this->m_valid || t.key_seq != this->m_key_seq)
+                return false;
+
+        // The grid is fixed from one keyframe to the next
+        cv::Size tile(t.tile_width, t.tile_height);
+        if (tile != this->m_tile || this->m_dirty.empty()) {
+                this->m_tile = tile;
+                this->m_cols = (this->m_key.cols + tile.width - 1) / tile.width;
+                int rows = (this->m_key.rows + tile.height - 1) / tile.height;
+                this->m_dirty.assign(this->m_cols * rows, false);
+        }
+
+        if (this->m_shared) {
+                this->m_canvas = this->m_key.clone();
+                this->m_shared = false;
+        }
+
+        // Tiles the last tiled frame had but this one does not are back 
+        // to how they were in the keyframe
+        std::vector<bool> dirty(this->m_dirty.size(), false);
+        for (const auto &tile : t.tiles) {
+                std::size_t i = (std::size_t) tile.row * this->m_cols + tile.col;
+                if (tile.col >= this->m_cols || i >= dirty.size())
+                        return false;
+                dirty[i] = true;
+        }
+        for (std::size_t i = 0; i < dirty.size(); ++i) {
+                if (this->m_dirty[i] && !dirty[i]) {
+                        auto rect = this->tile_rect(i % this->m_cols, i / this->m_cols);
+                        this->m_key(rect).copyTo(this->m_canvas(rect));
+                }
+        }
+        this->m_dirty.swap(dirty);
+
+        // Tiles are small, decoding each one on its own and copying it 
+        // into place costs next to nothing
+        for (const auto &tile : t.tiles) {
+                auto rect = this->tile_rect(tile.col, tile.row);
+                cv::Mat m;
+                if (!c.decode(d + tile.offset, tile.size, rect.size(), cv::IMREAD_COLOR, m)
+                        || m.size() != rect.size() || m.type() != this->m_canvas.type())
+                        return false;
+                m.copyTo(this->m_canvas(rect));
+        }
+
+        return true;
+}
@@ -0,0 +1,176 @@
+#include <zmqls/transform.hpp>
+
+#include <cmath>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+zmqls::transform::transform(const json_t &j)
+{
+        auto width = j.get<uint>(
+                "width", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto height = j.get<uint>(
+                "height", 0, &zmqls::json::wrapper::is_number_unsigned);
+        auto gamma = j.get<double>(
+                "gamma", -1, &zmqls::json::wrapper::is_number);
+        auto angle = j.get<int>(
+                "angle", 0, &zmqls::json::wrapper::is_number_integer);
+        auto flip = j.get<std::string>(
+                "flip", "", &zmqls::json::wrapper::is_string);
+
+        // Only resize if given both a custom width and height
+        int steps = 0;
+        if (width && height) {
+                this->m_size = cv::Size(width, height);
+                this->m_geometry = RESIZE;
+                ++steps;
+        }
+
+        // Parse the flip string and determine the flip mode
+        if (!flip.empty()) {
+                bool h = flip.find('h') != std::string::npos;
+                bool v = flip.find('v') != std::string::npos;
+                this->m_flip = (h != v) ? (h ? 1 : 0) : -1;
+                this->m_flip_on = true;
+                this->m_geometry = FLIP;
+                ++steps;
+        }
+
+        // Rotation, or any combination of steps, is one affine warp
+        if (angle)
+                this->m_angle = angle;
+        if (angle || steps > 1)
+                this->m_geometry = WARP;
+
+        // The gamma lookup table does not depend on the frame at all
+        if (gamma >= 0) {
+                this->m_lut.create(1, 256, CV_8U);
+                uint8_t *p = this->m_lut.ptr();
+                for (int i = 0; i < 256; ++i)
+                        p[i] = cv::saturate_cast<uint8_t>(pow(i / 255.0, gamma) * 255.0);
+        }
+}
+
+int zmqls::transform::decode_flags(const cv::Size &src) const
+{
+        static constexpr struct {
+                int factor;
+                int flags;
+        } reduced[] = {
+                {8, cv::IMREAD_REDUCED_COLOR_8},
+                {4, cv::IMREAD_REDUCED_COLOR_4},
+                {2, cv::IMREAD_REDUCED_COLOR_2}
+        };
+
+        // Nothing to gain without a resize, or without knowing the source
+        if (!this->m_size.area() || !src.area())
+                return cv::IMREAD_COLOR;
+
+        // Pick the largest reduction that still leaves enough pixels
+        for (const auto &r : reduced) {
+                if (this->m_size.width * r.factor <= src.width 
+                        && this->m_size.height * r.factor <= src.height)
+                        return r.flags;
+        }
+
+        return cv::IMREAD_COLOR;
+}
+
+void zmqls::transform::rebuild(const cv::Size &in)
+{
+        this->m_in_size = in;
+
+        // Size after resizing (flipping keeps the size)
+        cv::Size m = this->m_size.area() ? this->m_size : in;
+        this->m_out_size = m;
+
+        if (this->m_geometry != WARP)
+                return;
+
+        // Maps input pixel coordinates to output ones, built up one step 
+        // at a time in the order the steps used to be applied
+        cv::Matx33d a(1, 0, 0, 0, 1, 0, 0, 0, 1);
+
+        // Resize, matching cv::resize's pixel centre alignment
+        if (this->m_size.area()) {
+                double sx = (double) m.width / in.width;
+                double sy = (double) m.height / in.height;
+                a = cv::Matx33d(
+                        sx, 0, 0.5 * sx - 0.5, 
+                        0, sy, 0.5 * sy - 0.5, 
+                        0, 0, 1) * a;
+        }
+
+        // Flip around the y-axis (1), x-axis (0) or both (-1)
+        if (this->m_flip_on) {
+                bool h = this->m_flip != 0;
+                bool v = this->m_flip <= 0;
+                a = cv::Matx33d(
+                        h ? -1 : 1, 0, h ? m.width - 1 : 0, 
+                        0, v ? -1 : 1, v ? m.height - 1 : 0, 
+                        0, 0, 1) * a;
+        }
+
+        // Rotate around the centre, growing the output to the bounding box
+        if (this->m_angle) {
+                cv::Point2f c((m.width - 1) / 2.0, (m.height - 1) / 2.0);
+                cv::Mat r = cv::getRotationMatrix2D(c, this->m_angle, 1.0);
+
+                cv::Rect2f b = cv::RotatedRect(cv::Point2f(), m, this->m_angle)
+                        .boundingRect2f();
+                r.at<double>(0, 2) += b.width / 2.0 - m.width / 2.0;
+                r.at<double>(1, 2) += b.height / 2.0 - m.height / 2.0;
+                this->m_out_size = b.size();
+
+                a = cv::Matx33d(
+                        r.at<double>(0, 0), r.at<double>(0, 1), r.at<double>(0, 2), 
+                        r.at<double>(1, 0), r.at<double>(1, 1), r.at<double>(1, 2), 
+                        0, 0, 1) * a;
+        }
+
+        this->m_affine.create(2, 3, CV_64F);
+        for (int i = 0; i < 2; ++i) {
+                for (int j = 0; j < 3; ++j)
+                        this->m_affine.at<double>(i, j) = a(i, j);
+        }
+}
+
+void zmqls::transform::apply(const cv::Mat &in, cv::Mat &out)
+{
+        if (this->empty()) {
+                out = in;
+                return;
+        }
+
+        if (in.size() != this->m_in_size)
+                this->rebuild(in.size());
+
+        // One pass over the frame for all of the geometry, `src` is what 
+        // gamma correction then reads from
+        const cv::Mat *src = &out;
+        switch (this->m_geometry) {
+        case RESIZE:
+                // A reduced decode may have already hit the exact size
+                if (in.size() == this->m_size)
+                        src = &in;
+                else
+                        cv::resize(in, out, this->m_size, 0, 0, cv::INTER_LINEAR);
+                break;
+        case FLIP:
+                cv::flip(in, out, this->m_flip);
+                break;
+        case WARP:
+                cv::warpAffine(in, out, this->m_affine, this->m_out_size, 
+                        cv::INTER_LINEAR);
+                break;
+        case NONE:
+                src = &in;
+                break;
+        }
+
+        // Gamma correction, in place on the result if there was one
+        if (!this->m_lut.empty())
+                cv::LUT(*src, this->m_lut, out);
+        else if (src == &in)
+                out = in;
+}
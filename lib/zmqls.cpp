@@ -3,6 +3,10 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ctime>
 
 #include <zmq.hpp>
 #include <opencv2/opencv.hpp>
@@ -36,6 +40,116 @@ std::size_t zmqls::data_to_msg(
         return zmqls::data_to_msg(m, p.c_str(), p.length(), d.data(), d.size());
 }
 
+std::shared_ptr<zmqls::buffer_pool> zmqls::buffer_pool::create(std::size_t max_free)
+{
+        return std::shared_ptr<zmqls::buffer_pool>(new zmqls::buffer_pool(max_free));
+}
+
+zmqls::buffer_ptr_t zmqls::buffer_pool::acquire()
+{
+        // Reuse a free buffer if there is one
+        std::unique_ptr<buffer_t> b;
+        {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                if (!this->m_free.empty()) {
+                        b = std::move(this->m_free.back());
+                        this->m_free.pop_back();
+                }
+        }
+        if (!b)
+                b.reset(new buffer_t());
+
+        // Hand it back to us when the last owner is done, 
+        // unless the pool has gone away in the meantime
+        std::weak_ptr<buffer_pool> pool = this->shared_from_this();
+        return buffer_ptr_t(b.release(), [pool](buffer_t *p) {
+                if (auto sp = pool.lock())
+                        sp->release(p);
+                else
+                        delete p;
+        });
+}
+
+std::size_t zmqls::buffer_pool::free_count() const
+{
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_free.size();
+}
+
+void zmqls::buffer_pool::release(buffer_t *b)
+{
+        std::unique_ptr<buffer_t> p(b);
+        p->clear();
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        if (this->m_free.size() < this->m_max_free)
+                this->m_free.push_back(std::move(p));
+}
+
+// Called by ZMQ once it no longer needs the message data
+static void release_buffer(void *, void *hint)
+{
+        delete static_cast<zmqls::buffer_ptr_t *>(hint);
+}
+
+std::size_t zmqls::data_to_msg(zmq::message_t &m, const buffer_ptr_t &d)
+{
+        // The message keeps its own reference to the buffer until it is sent
+        size_t sz = d->size();
+        zmq::message_t msg(d->data(), sz, &release_buffer, new buffer_ptr_t(d));
+
+        m.move(&msg);
+
+        return sz;
+}
+
+std::size_t zmqls::recv_parts(zmq::socket_t &s, std::vector<zmq::message_t> &parts)
+{
+        parts.clear();
+        do {
+                parts.emplace_back();
+                if (!s.recv(&parts.back())) {
+                        parts.pop_back();
+                        break;
+                }
+        } while (parts.back().more());
+
+        return parts.size();
+}
+
+bool zmqls::send_parts(zmq::socket_t &s, std::vector<zmq::message_t> &parts)
+{
+        for (std::size_t i = 0; i < parts.size(); ++i) {
+                if (!s.send(parts[i], i + 1 < parts.size() ? ZMQ_SNDMORE : 0))
+                        return false;
+        }
+
+        return true;
+}
+
+void zmqls::image_to_data(std::vector<uint8_t> &v, const cv::Mat &m)
+{
+        // Raw pixel bytes, row after row without any padding
+        size_t row = m.cols * m.elemSize();
+        v.resize(row * m.rows);
+
+        if (m.isContinuous()) {
+                memcpy(v.data(), m.ptr(), v.size());
+        } else {
+                for (int i = 0; i < m.rows; ++i)
+                        memcpy(v.data() + i * row, m.ptr(i), row);
+        }
+}
+
+int64_t zmqls::thread_cpu_us()
+{
+        timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+                return 0;
+
+        return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 uint8_t *zmqls::get_beg(const zmq::message_t &m, const size_t &p_sz)
 {
         return (uint8_t *) m.data() + p_sz;
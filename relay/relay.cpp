@@ -0,0 +1,39 @@
+#include <zmqls/relay.hpp>
+
+#include <iostream>
+
+#include <zmq.hpp>
+
+#include <zmqls/zmqls.hpp>
+#include <zmqls/cl_args.hpp>
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+        // Setup the cl_args object
+        zmqls::cl_args args(zmqls::cl_args::RELAY);
+
+        // Parse and check command-line arguments
+        int check;
+        if ((check = args.parse(argc, argv)) != 0 || args.help)
+                return check;
+
+        // Create ZMQ context
+        zmq::context_t ctx(args.threads);
+
+        // Try starting every stream by parsing the input file
+        try {
+                auto configs = zmqls::stream::configs(args.file);
+                if (configs.empty()) {
+                        cerr << args.name << ": No streams in input file" << endl;
+                        return EXIT_FAILURE;
+                }
+
+                return zmqls::run_streams<zmqls::relay::stream>(ctx, configs);
+        } catch (const nlohmann::json::parse_error &e) {
+                cerr << args.name 
+                        << ": Failed to parse input file: " << e.what() << endl;
+                return EXIT_FAILURE;
+        }
+}